@@ -0,0 +1,33 @@
+#ifndef ASSEMBLER_HH__
+#define ASSEMBLER_HH__
+
+#include "lib.hh"
+#include "util.hh"
+#include "objects.hh"
+#include "heap.hh"
+#include "symbol_table.hh"
+
+/*
+    Lowers the list form of the bytecode, a Vector of instructions that
+    are each a list of an opcode symbol and its operands, into Code.
+
+    Operands are encoded inline or put in the constant pool as described
+    by their format in PER_OPCODE. The instruction lists of lambda bodies
+    are lowered too, so running Code never looks at the list form. A halt
+    ends every Code so the interpreter never checks for the end. Every
+    constant operand gets a pool entry of its own, since instructions may
+    replace theirs when they are linked.
+*/
+class Assembler {
+public:
+    static Handle Assemble(Heap* heap, SymbolTable* symbols, Handle instructions);
+
+private:
+    static void encodeOperand(std::vector<std::uint8_t>& bytes, std::int64_t value);
+
+    static std::int64_t integerOperand(Primitive operand);
+
+    [[noreturn]] static void throwMalformed(SymbolTable* symbols, Symbol opcode, const char* reason);
+};
+
+#endif // ASSEMBLER_HH__
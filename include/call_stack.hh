@@ -0,0 +1,103 @@
+#ifndef CALL_STACK_HH__
+#define CALL_STACK_HH__
+
+#include "lib.hh"
+#include "util.hh"
+#include "objects.hh"
+#include "heap.hh"
+
+/*
+    Frames of the running calls, kept off the heap so calls and returns
+    never allocate. Every frame is SLOTS values in one of a list of fixed
+    size segments. A segment never grows past the room it reserved, so a
+    frame stays at the same address for as long as it is on the stack, and
+    every segment is a root range of the heap, so a collection updates
+    frames in place.
+
+    Frames only move to the heap, as Frame objects, when a continuation
+    is captured.
+*/
+class CallStack {
+public:
+    enum Slot : std::size_t {
+        CODE,            // Code being run
+        ENV,             // Environment, or Integer base of its native locals
+        CLOSURE,         // Lambda being run, nil at top level
+        TEMPS,           // Integer offset of its first temp on the operand stack
+        PROGRAM_COUNTER, // Integer byte offset into the code, only written on leave
+        MARK,            // EscapeContinuation or Prompt it was called with, or nil
+        SLOTS
+    };
+
+    static constexpr std::size_t FRAMES_PER_SEGMENT = 256;
+
+    CallStack(Heap* _heap) : heap{_heap} {}
+
+    ~CallStack() {
+        for (std::unique_ptr<std::vector<Primitive>>& segment : segments) {
+            heap->RemoveRootRange(segment.get());
+        }
+    }
+
+    NOT_COPYABLE(CallStack);
+
+    NOT_MOVEABLE(CallStack);
+
+    // pushes a frame with every slot nil and returns its first slot
+    Primitive* Push() {
+        std::size_t index = depth / FRAMES_PER_SEGMENT;
+        if (index == segments.size()) {
+            DEBUGLN("Adding call stack segment " << index);
+            segments.push_back(std::make_unique<std::vector<Primitive>>());
+            segments.back()->reserve(FRAMES_PER_SEGMENT * SLOTS);
+            heap->AddRootRange(segments.back().get());
+        }
+        std::vector<Primitive>* segment = segments[index].get();
+        std::size_t offset = segment->size();
+        segment->resize(offset + SLOTS, Nil());
+        depth += 1;
+        return &(*segment)[offset];
+    }
+
+    void Pop() {
+        if (depth == 0) {
+            throw std::runtime_error{"Pop called on empty call stack"};
+        }
+        depth -= 1;
+        std::vector<Primitive>* segment = segments[depth / FRAMES_PER_SEGMENT].get();
+        segment->resize(segment->size() - SLOTS);
+    }
+
+    Primitive* Top() {
+        return At(depth - 1);
+    }
+
+    // the index'th frame from the bottom
+    Primitive* At(std::size_t index) {
+        return &(*segments.at(index / FRAMES_PER_SEGMENT))[(index % FRAMES_PER_SEGMENT) * SLOTS];
+    }
+
+    std::size_t Depth() const {
+        return depth;
+    }
+
+    bool Empty() const {
+        return depth == 0;
+    }
+
+    // empty segments are kept for the next calls, they cost the collector
+    // nothing to scan
+    void Clear() {
+        for (std::unique_ptr<std::vector<Primitive>>& segment : segments) {
+            segment->clear();
+        }
+        depth = 0;
+    }
+
+private:
+    Heap* heap;
+    std::vector<std::unique_ptr<std::vector<Primitive>>> segments;
+    std::size_t depth = 0;
+};
+
+#endif // CALL_STACK_HH__
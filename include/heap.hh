@@ -4,6 +4,7 @@
 #include "lib.hh"
 #include "util.hh"
 #include "objects.hh"
+#include "symbol_table.hh"
 
 class SemiSpaceIterator;
 
@@ -105,6 +106,8 @@ public:
 class RootManager {
 private:
     std::set<Primitive*> roots;
+    // native arrays of values owned outside the heap, every element is a root
+    std::set<std::vector<Primitive>*> ranges;
 public:
     RootManager() = default;
     ~RootManager() = default;
@@ -123,6 +126,18 @@ public:
     const std::set<Primitive*>& GetRoots() const {
         return roots;
     }
+
+    void AddRootRange(std::vector<Primitive>* range) {
+        ranges.insert(range);
+    }
+
+    void RemoveRootRange(std::vector<Primitive>* range) {
+        ranges.erase(range);
+    }
+
+    const std::set<std::vector<Primitive>*>& GetRootRanges() const {
+        return ranges;
+    }
 };
 
 class HandleBlock {
@@ -173,6 +188,10 @@ public:
         location = block->Data();
     }
 
+    Primitive Data() const {
+        return block->Data();
+    }
+
     #define DEFINE_CASTERS(V) \
         V* As##V() { \
             return block->DataPtr()->AsReference()->Value()->As##V(); \
@@ -189,6 +208,15 @@ public:
 };
 
 class Heap {
+public:
+    // told about every gc once everything live was moved, while the old
+    // space still holds what was left behind, so whatever keeps pointers
+    // to objects outside the heap can follow or drop them with Survivor
+    class GcObserver {
+    public:
+        virtual ~GcObserver() = default;
+        virtual void AfterGc() = 0;
+    };
 private:
     static constexpr std::size_t ALIGNMENT = 8;
     SemiSpace space1;
@@ -196,6 +224,10 @@ private:
     SemiSpace* active;
     SemiSpace* passive;
     RootManager roots;
+    // optional, when set unreferenced symbols are reclaimed on every gc
+    SymbolTable* symbols = nullptr;
+    // optional, told about every gc
+    GcObserver* observer = nullptr;
 public:
     Heap(std::size_t size) : space1{size}, space2{size} {
         active = &space1;
@@ -208,6 +240,33 @@ public:
 
     NOT_MOVEABLE(Heap);
 
+    // the table must not be given to any other heap
+    void SetSymbolTable(SymbolTable* table) {
+        if (table != nullptr) {
+            table->Attach(this);
+        }
+        symbols = table;
+    }
+
+    void SetGcObserver(GcObserver* _observer) {
+        observer = _observer;
+    }
+
+    // where an object from before the last gc was moved to, null if it
+    // was garbage. only meaningful from GcObserver::AfterGc
+    static Object* Survivor(Object* obj) {
+        return obj->IsGcForward() ? obj->GetGcForwardAddress() : nullptr;
+    }
+
+    // the range may grow and shrink freely, it is only read during a gc
+    void AddRootRange(std::vector<Primitive>* range) {
+        roots.AddRootRange(range);
+    }
+
+    void RemoveRootRange(std::vector<Primitive>* range) {
+        roots.RemoveRootRange(range);
+    }
+
     Handle GetHandle(Primitive val) {
         std::shared_ptr<HandleBlock> hb = std::make_shared<HandleBlock>(&roots, val);
         Handle ret{hb};
@@ -231,6 +290,16 @@ public:
         return ret;
     }
 
+    // the descriptor decides the number of fields
+    Handle NewRecord(Handle descriptor) {
+        std::size_t fields = descriptor.AsRecordType()->FieldCount().Value();
+        void* addr = Allocate(Record::AllocationSize(fields));
+        Record* ptr = new (addr) Record(fields, descriptor);
+        std::shared_ptr<HandleBlock> hb = std::make_shared<HandleBlock>(&roots, Reference(ptr));
+        Handle ret{hb};
+        return ret;
+    }
+
     Handle NewString(const std::string& str) {
         void* addr = Allocate(String::AllocationSize(str));
         String* ptr = new (addr) String(str);
@@ -239,6 +308,39 @@ public:
         return ret;
     }
 
+    Handle NewCode(const std::vector<std::uint8_t>& bytes, Handle constants) {
+        void* addr = Allocate(Code::AllocationSize(bytes.size()));
+        Code* ptr = new (addr) Code(bytes, constants);
+        std::shared_ptr<HandleBlock> hb = std::make_shared<HandleBlock>(&roots, Reference(ptr));
+        Handle ret{hb};
+        return ret;
+    }
+
+    // an empty string with room for capacity bytes, see StringBuilder
+    Handle NewStringBuffer(std::size_t capacity) {
+        void* addr = Allocate(String::BufferAllocationSize(capacity));
+        String* ptr = new (addr) String(capacity);
+        std::shared_ptr<HandleBlock> hb = std::make_shared<HandleBlock>(&roots, Reference(ptr));
+        Handle ret{hb};
+        return ret;
+    }
+
+    Handle NewStringBuilder() {
+        return StructureAllocator<StringBuilder>();
+    }
+
+    Handle NewRope(Handle left, Handle right, Handle length) {
+        return StructureAllocator<Rope>(left, right, length);
+    }
+
+    Handle NewCell(Handle name) {
+        return StructureAllocator<Cell>(name);
+    }
+
+    Handle NewBox(Handle value) {
+        return StructureAllocator<Box>(value);
+    }
+
     Handle NewPair(Handle first, Handle second) {
         return StructureAllocator<Pair>(first, second);
     }
@@ -247,20 +349,56 @@ public:
         return StructureAllocator<Map>();
     }
 
-    Handle NewEnvironment(Handle outer, Handle lookup) {
-        return StructureAllocator<Envrionment>(outer, lookup);
+    Handle NewGrowableVector() {
+        return StructureAllocator<GrowableVector>();
+    }
+
+    Handle NewEqHashtable() {
+        return StructureAllocator<EqHashtable>();
+    }
+
+    Handle NewPersistentMap() {
+        return StructureAllocator<PersistentMap>();
+    }
+
+    Handle NewPersistentVector() {
+        return StructureAllocator<PersistentVector>();
+    }
+
+    Handle NewRecordType(Handle name, Handle fields) {
+        return StructureAllocator<RecordType>(name, fields);
+    }
+
+    Handle NewEnvironment(Handle outer, Handle lookup, Handle slots) {
+        return StructureAllocator<Envrionment>(outer, lookup, slots);
     }
 
     Handle NewStack() {
         return StructureAllocator<Stack>();
     }
 
-    Handle NewFrame(Handle bytecode, Handle outer, Handle temps, Handle env) {
-        return StructureAllocator<Frame>(bytecode, outer, temps, env);
+    Handle NewFrame(Handle bytecode, Handle outer, Handle temps, Handle env, Handle closure) {
+        return StructureAllocator<Frame>(bytecode, outer, temps, env, closure);
     }
 
-    Handle NewNativeFunction(Handle ptr, Handle arity) {
-        return StructureAllocator<NativeFunction>(ptr, arity);
+    Handle NewContinuation(Handle frame, Handle prompt) {
+        return StructureAllocator<Continuation>(frame, prompt);
+    }
+
+    Handle NewPrompt(Handle tag) {
+        return StructureAllocator<Prompt>(tag);
+    }
+
+    Handle NewEscapeContinuation(Handle depth) {
+        return StructureAllocator<EscapeContinuation>(depth);
+    }
+
+    Handle NewNativeFunction(Handle index, Handle arity) {
+        return StructureAllocator<NativeFunction>(index, arity);
+    }
+
+    Handle NewLambda(Handle parameters, Handle free, Handle bytecode, Handle locals, Handle heap_locals) {
+        return StructureAllocator<Lambda>(parameters, free, bytecode, locals, heap_locals);
     }
 
 private:
@@ -300,6 +438,12 @@ private:
             DEBUGLN("Visiting root at " << root);
             transferIfReference(root);
         }
+        for (std::vector<Primitive>* range : roots.GetRootRanges()) {
+            DEBUGLN("Visiting root range of " << range->size() << " values");
+            for (Primitive& root : *range) {
+                transferIfReference(&root);
+            }
+        }
     }
 
     void transferIfReference(Primitive* location) {
@@ -314,7 +458,11 @@ private:
 
             void OnNil(const Nil*) override {/* intentionally empty */}
             void OnInteger(const Integer*) override {/* intentionally empty */}
-            void OnSymbol(const Symbol*) override {/* intentionally empty */}
+            void OnSymbol(const Symbol* sym) override {
+                if (heap->symbols != nullptr) {
+                    heap->symbols->Mark(*sym);
+                }
+            }
             void OnReal(const Real*) override {/* intentionally empty */}
             void OnBoolean(const Boolean*) override {/* intentionally empty */}
             void OnNativeReference(const NativeReference*) override {/* intentionally empty */}
@@ -364,6 +512,10 @@ private:
         active = passive;
         passive = temp;
 
+        if (symbols != nullptr) {
+            symbols->BeginMarking();
+        }
+
         // marks all the roots, transferring them to the
         // opposite space in the process
         mark();
@@ -372,6 +524,15 @@ private:
         // and pull over all their children
         transfer();
 
+        // every symbol still referenced was marked while transferring
+        if (symbols != nullptr) {
+            symbols->Sweep();
+        }
+
+        if (observer != nullptr) {
+            observer->AfterGc();
+        }
+
         // gc the passive size
         DEBUGLN("Clearing old heap");
         passive->Clear();
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <string>
 #include <stdexcept>
+#include <exception>
 #include <limits>
 #include <sstream>
 #include <memory>
@@ -15,5 +16,12 @@
 #include <initializer_list>
 #include <type_traits>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <string_view>
+#include <deque>
+#include <functional>
+#include <bit>
+#include <algorithm>
 
 #endif // LIB_STD_HH__
\ No newline at end of file
@@ -2,9 +2,17 @@
 #define OBJECT_MOD_HH__ 
 
 #include "objects/boolean.hh"
+#include "objects/box.hh"
+#include "objects/cell.hh"
 #include "objects/character.hh"
+#include "objects/code.hh"
+#include "objects/continuation.hh"
 #include "objects/env.hh"
+#include "objects/eq_hashtable.hh"
+#include "objects/equality.hh"
+#include "objects/escape_continuation.hh"
 #include "objects/frame.hh"
+#include "objects/growable_vector.hh"
 #include "objects/integer.hh"
 #include "objects/lambda.hh"
 #include "objects/map.hh"
@@ -13,13 +21,20 @@
 #include "objects/nil.hh"
 #include "objects/object.hh"
 #include "objects/pair.hh"
+#include "objects/persistent_map.hh"
+#include "objects/persistent_vector.hh"
 #include "objects/primitive.hh"
+#include "objects/prompt.hh"
 #include "objects/real.hh"
+#include "objects/record.hh"
+#include "objects/record_type.hh"
+#include "objects/rope.hh"
 #include "objects/reference.hh"
 #include "objects/slotiter.hh"
 #include "objects/slottedobject.hh"
 #include "objects/stack.hh"
 #include "objects/string.hh"
+#include "objects/string_builder.hh"
 #include "objects/structure.hh"
 #include "objects/symbol.hh"
 #include "objects/vector.hh"
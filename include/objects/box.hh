@@ -0,0 +1,19 @@
+#ifndef BOX_HH__
+#define BOX_HH__
+
+#include "structure.hh"
+
+// a captured variable that is also assigned, the slot and every closure
+// that captured it share the box so assignments are seen by all of them
+class Box : public Structure<Object::Type::Box, 1> {
+public:
+    Box(Handle _value);
+
+    ~Box() = default;
+
+    FIELD(0, Value);
+};
+
+static_assert(sizeof(Box) == sizeof(Object));
+
+#endif // BOX_HH__
@@ -0,0 +1,29 @@
+#ifndef CELL_HH__
+#define CELL_HH__
+
+#include "structure.hh"
+#include "boolean.hh"
+
+// a global binding, global instructions hold a reference to their cell
+// so accessing a global is a single indirection
+class Cell : public Structure<Object::Type::Cell, 3> {
+public:
+    Cell(Handle _name);
+
+    ~Cell() = default;
+
+    FIELD(0, Name);
+
+    FIELD(1, Value);
+
+    // cells are created unbound when first referenced and bound by define
+    FIELD(2, Bound);
+
+    bool IsBound() const {
+        return ConstBound().AsConstBoolean()->Value();
+    }
+};
+
+static_assert(sizeof(Cell) == sizeof(Object));
+
+#endif // CELL_HH__
@@ -7,13 +7,13 @@
 
 class Character : public Primitive {
 public:
-    Character(char value) {
-        SetCharacter(value);
+    Character(std::uint32_t codepoint) {
+        SetCharacter(codepoint);
     }
 
     ~Character() = default;
 
-    char Value() const {
+    std::uint32_t Value() const {
         return GetCharacter();
     }
 };
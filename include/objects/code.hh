@@ -0,0 +1,129 @@
+#ifndef CODE_HH__
+#define CODE_HH__
+
+#include "lib/std.hh"
+#include "well_known_symbols.hh"
+#include "object.hh"
+#include "integer.hh"
+
+class JitCode;
+
+/*
+    Code layout
+        Object header
+        Primitive constants - Vector of the operands that are not inline
+        Primitive length    - number of bytes of instructions
+        uint64 calls        - calls of lambdas running it so far
+        JitCode* native     - machine code compiled from it, or null
+        uint8 bytes[]       - each instruction is its opcode followed by
+                              its operands, OPERAND_SIZE bytes each
+
+    Made by the Assembler from the list form of the bytecode. The program
+    counter of a frame is a byte offset into it. Only the constants are
+    references, so they are the only slot the collector visits. The
+    machine code is owned by the virtual machine that compiled it.
+*/
+class Code : public Object {
+public:
+    constexpr static std::size_t OPERAND_SIZE = sizeof(std::uint32_t);
+    constexpr static std::size_t MAX_OPERANDS = WellKnownSymbols::MaxOperandCount();
+
+    struct Instruction {
+        std::uint8_t opcode;
+        std::array<std::uint32_t, MAX_OPERANDS> operands;
+    };
+
+    Code(const std::vector<std::uint8_t>& bytes, Handle constants);
+
+    ~Code() = default;
+
+    Primitive& Constants() { return *slot(0); }
+
+    Integer Length() const { return *slot(1)->AsConstInteger(); }
+
+    // counts a call and yields the calls so far
+    std::uint64_t CountCall() {
+        return ++header()->calls;
+    }
+
+    JitCode* Native() const { return header()->native; }
+
+    void SetNative(JitCode* native) { header()->native = native; }
+
+    std::uint8_t OpcodeAt(std::size_t pc) const {
+        return bytes()[pc];
+    }
+
+    // quickens the instruction at pc or takes it back to the generic one,
+    // both must have the same format
+    void SetOpcodeAt(std::size_t pc, std::uint8_t opcode) {
+        bytes()[pc] = opcode;
+    }
+
+    Instruction Decode(std::size_t pc) const {
+        Instruction result{};
+        result.opcode = OpcodeAt(pc);
+        std::size_t count = OperandCount(result.opcode);
+        const std::uint8_t* operand = &bytes()[pc + 1];
+        for (std::size_t i = 0; i < count; i++) {
+            std::memcpy(&result.operands[i], operand + i * OPERAND_SIZE, OPERAND_SIZE);
+        }
+        return result;
+    }
+
+    static std::size_t OperandCount(std::uint8_t opcode) {
+        return WellKnownSymbols::OPERANDS[opcode].size();
+    }
+
+    static std::size_t InstructionSize(std::uint8_t opcode) {
+        return 1 + OperandCount(opcode) * OPERAND_SIZE;
+    }
+
+    bool HasNext(std::size_t i) const {
+        return i == 0;
+    }
+
+    Primitive* Next(std::size_t i) const {
+        if (!HasNext(i)) {
+            throw std::runtime_error{"Next called on Code without next"};
+        }
+        return slot(0);
+    }
+
+    static std::size_t AllocationSize(std::size_t bytes) {
+        std::size_t size = MinAllocationSize() + bytes;
+        if (size % sizeof(Object) != 0) {
+            size = (size / sizeof(Object) + 1) * sizeof(Object);
+        }
+        return size;
+    }
+
+    constexpr static std::size_t MinAllocationSize() {
+        return sizeof(Object) + 2 * sizeof(Primitive) + sizeof(NativeHeader);
+    }
+
+private:
+    struct NativeHeader {
+        std::uint64_t calls;
+        JitCode* native;
+    };
+
+    NativeHeader* header() const {
+        char* data = reinterpret_cast<char*>(const_cast<Code*>(this));
+        return reinterpret_cast<NativeHeader*>(&data[sizeof(Object) + 2 * sizeof(Primitive)]);
+    }
+
+    Primitive* slot(std::size_t i) const {
+        Primitive* head = reinterpret_cast<Primitive*>(const_cast<Code*>(this));
+        return &head[i + 1];
+    }
+
+    std::uint8_t* bytes() const {
+        char* data = reinterpret_cast<char*>(const_cast<Code*>(this));
+        return reinterpret_cast<std::uint8_t*>(&data[MinAllocationSize()]);
+    }
+};
+
+static_assert(sizeof(Code) == sizeof(Object));
+
+#endif // CODE_HH__
@@ -3,13 +3,19 @@
 
 #include "structure.hh"
 
-class Continuation : public Structure<Object::Type::Continuation, 1> {
+class Continuation : public Structure<Object::Type::Continuation, 2> {
 public:
-    Continuation(Handle _frame);
+    Continuation(Handle _frame, Handle _prompt);
 
     ~Continuation() = default;
 
+    // heap Frame to resume, its Outer chain is the rest of the continuation
     FIELD(0, Frame);
+
+    // nil for a full continuation, which replaces the whole call stack.
+    // otherwise it is delimited by this Prompt, its frames run up to the
+    // one marked with it and are pushed on top of the caller's
+    FIELD(1, Prompt);
 };
 
 #endif // CONTINUATION_HH__
\ No newline at end of file
@@ -3,19 +3,47 @@
 
 #include "lib/std.hh"
 #include "structure.hh"
+#include "symbol.hh"
 #include "map.hh"
+#include "vector.hh"
+#include "cell.hh"
 
-class Envrionment : public Structure<Object::Type::Envrionment, 2> {
+/*
+    Lookup - Map from symbol to the Cell holding a dynamically defined
+             variable, only created for environments that are defined
+             into (eg: the global environment)
+    Slots  - Vector of lexically addressed locals, indexed directly by the
+             loadlocal and storelocal opcodes
+*/
+class Envrionment : public Structure<Object::Type::Envrionment, 3> {
 public:
-    Envrionment(Handle _outer, Handle _lookup);
+    Envrionment(Handle _outer, Handle _lookup, Handle _slots);
 
     ~Envrionment() = default;
 
     FIELD(0, Outer);
 
     FIELD(1, Lookup);
+
+    FIELD(2, Slots);
+
+    // walks outwards from self, returns a pointer to the bound value or
+    // nullptr if symbol is unbound. only valid until the next allocation.
+    static Primitive* Lookup(Envrionment* self, Symbol symbol);
+
+    static void Define(Heap* heap, Handle self, Symbol symbol, Handle value);
+
+    // the cell for symbol in self, created unbound if it does not exist yet
+    static Handle Intern(Heap* heap, Handle self, Symbol symbol);
+
+    // the environment depth levels out from self
+    static Envrionment* Resolve(Envrionment* self, std::int64_t depth);
+
+    Vector* SlotVector() {
+        return Slots().AsReference()->Value()->AsVector();
+    }
 };
 
 static_assert(sizeof(Envrionment) == sizeof(Object));
 
-#endif // ENV_HH__
\ No newline at end of file
+#endif // ENV_HH__
@@ -0,0 +1,43 @@
+#ifndef EQ_HASHTABLE_HH__
+#define EQ_HASHTABLE_HH__
+
+#include "lib/std.hh"
+#include "structure.hh"
+#include "integer.hh"
+#include "vector.hh"
+
+/*
+    Hash table keyed by identity (eq?), stored as described in
+    OpenAddressing.
+
+    Objects hash by Object::IdentityHash, which the collector copies with
+    the object, and the buckets are traced like any Vector, so a
+    collection leaves the table valid without rehashing.
+*/
+class EqHashtable : public Structure<Object::Type::EqHashtable, 2> {
+public:
+    EqHashtable();
+
+    ~EqHashtable() = default;
+
+    FIELD(0, Count);
+
+    FIELD(1, Buckets);
+
+    // pointer to the value stored for key, or nullptr if key is not
+    // present. only valid until the next allocation.
+    static Primitive* Find(EqHashtable* self, Primitive key);
+
+    static void Insert(Heap* heap, Handle self, Handle key, Handle value);
+
+    // false if key was not present
+    static bool Remove(EqHashtable* self, Primitive key);
+
+    static std::uint64_t Hash(Primitive key);
+
+    static bool KeyEquals(Primitive k1, Primitive k2);
+};
+
+static_assert(sizeof(EqHashtable) == sizeof(Object));
+
+#endif // EQ_HASHTABLE_HH__
@@ -0,0 +1,56 @@
+#ifndef EQUALITY_HH__
+#define EQUALITY_HH__
+
+#include "lib/std.hh"
+#include "primitive.hh"
+#include "object.hh"
+
+/*
+    Structural equality and hashing, the semantics of equal? and
+    equal-hash.
+
+    Pairs and Vectors are equal when their items are, Strings and Ropes
+    when their characters are, every other object only to itself.
+
+    Comparison first runs with a budget of FAST_BUDGET object pairs and no
+    bookkeeping. Only if that runs out, which is what a cyclic structure
+    does, it is redone remembering every pair of objects already assumed
+    equal, so revisiting one ends that branch instead of looping.
+
+    Hashing visits at most HASH_BUDGET values, which bounds its cost and
+    makes it terminate on cycles. Equal values always hash the same, other
+    objects hash by their identity hash.
+    Neither allocates, so raw pointers stay valid throughout.
+*/
+class Equality {
+public:
+    constexpr static std::size_t FAST_BUDGET = 1000;
+    constexpr static std::size_t HASH_BUDGET = 64;
+
+    static bool Equal(Primitive a, Primitive b);
+
+    static std::uint64_t Hash(Primitive value);
+
+    // splitmix64 finalizer
+    static std::uint64_t Mix(std::uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+private:
+    using Assumed = std::set<std::pair<const Object*, const Object*>>;
+
+    // assumed is nullptr for the budgeted pass, which sets exhausted
+    // instead of answering when the budget runs out
+    static bool compare(Primitive a, Primitive b, Assumed* assumed, bool* exhausted);
+
+    static bool isStringLike(Primitive value);
+
+    static std::uint64_t immediateHash(Primitive value);
+};
+
+#endif // EQUALITY_HH__
@@ -0,0 +1,20 @@
+#ifndef ESCAPE_CONTINUATION_HH__
+#define ESCAPE_CONTINUATION_HH__
+
+#include "structure.hh"
+
+// continuation made by call/ec, only valid while the call it was made
+// for has not returned. the frame of that call is marked with it, and
+// invoking it unwinds to the mark instead of copying any frames
+class EscapeContinuation : public Structure<Object::Type::EscapeContinuation, 1> {
+public:
+    EscapeContinuation(Handle _depth);
+
+    ~EscapeContinuation() = default;
+
+    // Integer call stack depth of the marked frame when it was made, where
+    // unwinding looks for the mark first
+    FIELD(0, Depth);
+};
+
+#endif // ESCAPE_CONTINUATION_HH__
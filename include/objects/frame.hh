@@ -3,43 +3,49 @@
 
 #include "structure.hh"
 #include "integer.hh"
-#include "vector.hh"
+#include "code.hh"
 
-class Frame : public Structure<Object::Type::Frame, 5> {
+// a call moved off the VM call stack into the heap when a continuation
+// was captured. it is never changed once made, returning into it copies
+// it back onto the call stack, so a continuation can be resumed any
+// number of times
+class Frame : public Structure<Object::Type::Frame, 7> {
 public:
-    Frame(Handle _bytecode, Handle _outer, Handle _temps, Handle _env);
+    Frame(Handle _bytecode, Handle _outer, Handle _temps, Handle _env, Handle _closure);
 
     ~Frame() = default;
 
+    // Code being run, the program counter is a byte offset into it
     FIELD(0, Bytecode);
 
     FIELD(1, Outer);
 
+    // Vector of the temps it had when it was moved off the call stack
     FIELD(2, Temps);
 
     FIELD(3, Env);
 
     FIELD(4, ProgramCounter);
 
-    Integer BytecodeLength() const {
-        return ConstBytecodeVector()->Length();
-    }
+    // Lambda being run, source of the free variables, nil at top level
+    FIELD(5, Closure);
 
-    Primitive NextBytecode() const {
-        Integer pc = *ConstProgramCounter().AsConstInteger();
-        const Vector* v = ConstBytecodeVector();
-        return v->GetItem(pc);
+    // EscapeContinuation or Prompt the frame was called with, or nil
+    FIELD(6, Mark);
+
+    Integer BytecodeLength() const {
+        return ConstCode()->Length();
     }
 
-    void AdvanceProgramCounter() {
+    void OffsetProgramCounter(std::int64_t offset) {
         Integer pc = *ConstProgramCounter().AsConstInteger();
-        pc = Integer(pc.Value() + 1);
+        pc = Integer(pc.Value() + offset);
         ProgramCounter() = pc;
     }
 
 private:
-    const Vector* ConstBytecodeVector() const {
-        return ConstBytecode().AsConstReference()->Value()->AsConstVector();
+    const Code* ConstCode() const {
+        return ConstBytecode().AsConstReference()->Value()->AsConstCode();
     }
 };
 
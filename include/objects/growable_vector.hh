@@ -0,0 +1,54 @@
+#ifndef GROWABLE_VECTOR_HH__
+#define GROWABLE_VECTOR_HH__
+
+#include "lib/std.hh"
+#include "structure.hh"
+#include "integer.hh"
+#include "vector.hh"
+
+/*
+    Vector that can be appended to in amortized constant time.
+
+    Items is nil until the first push, afterwards a Vector whose length is
+    the capacity. Only the first Count items are in use, the rest are nil.
+    The capacity doubles when it runs out, so n pushes copy at most 2n
+    items in total.
+*/
+class GrowableVector : public Structure<Object::Type::GrowableVector, 2> {
+public:
+    constexpr static std::size_t INITIAL_CAPACITY = 8;
+
+    GrowableVector();
+
+    ~GrowableVector() = default;
+
+    FIELD(0, Count);
+
+    FIELD(1, Items);
+
+    Integer Length() {
+        return *Count().AsInteger();
+    }
+
+    static Primitive Get(GrowableVector* self, Integer index);
+
+    static void Set(GrowableVector* self, Integer index, Primitive value);
+
+    static void Push(Heap* heap, Handle self, Handle value);
+
+    static Handle Pop(Heap* heap, Handle self);
+
+    // a Vector of exactly the items in use
+    static Handle ToVector(Heap* heap, Handle self);
+
+private:
+    static std::size_t capacity(GrowableVector* self);
+
+    static void checkIndex(GrowableVector* self, Integer index);
+
+    static void grow(Heap* heap, Handle self);
+};
+
+static_assert(sizeof(GrowableVector) == sizeof(Object));
+
+#endif // GROWABLE_VECTOR_HH__
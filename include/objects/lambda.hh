@@ -2,16 +2,33 @@
 #define LAMBDA_HH__
 
 #include "structure.hh"
+#include "boolean.hh"
 
-class Lambda : public Structure<Object::Type::Lambda, 3> {
+class Lambda : public Structure<Object::Type::Lambda, 5> {
 public:
-    Lambda(Handle _args, Handle _env, Handle _bytecode);
+    Lambda(Handle _parameters, Handle _free, Handle _bytecode, Handle _locals, Handle _heap_locals);
 
-    FIELD(0, Function);
+    // Vector of parameter symbols, its length is the arity
+    FIELD(0, Parameters);
 
-    FIELD(1, Env);
+    // Vector of the captured values in the order the compiler listed them,
+    // assigned variables are captured as their Box
+    FIELD(1, Free);
 
+    // Code of the body
     FIELD(2, Bytecode);
+
+    // Integer number of local slots, parameters first
+    FIELD(3, Locals);
+
+    // Boolean, set by the compiler when the locals are known to be captured
+    // by a continuation so they go straight to the heap instead of being
+    // promoted from the native locals region later
+    FIELD(4, HeapLocals);
+
+    bool HasHeapLocals() const {
+        return ConstHeapLocals().AsConstBoolean()->Value();
+    }
 };
 
-#endif // LAMBDA_HH__
\ No newline at end of file
+#endif // LAMBDA_HH__
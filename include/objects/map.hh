@@ -3,17 +3,39 @@
 
 #include "lib/std.hh"
 #include "structure.hh"
-#include "pair.hh"
+#include "integer.hh"
+#include "vector.hh"
 
-class Map : public Structure<Object::Type::Map, 1> {
+/*
+    Hash map keyed by equal?, stored as described in OpenAddressing.
+
+    Pairs, vectors and strings can be keys as long as they are not
+    mutated afterwards. Other objects are keyed by identity.
+*/
+class Map : public Structure<Object::Type::Map, 2> {
 public:
     Map();
 
     ~Map() = default;
 
-    FIELD(0, Head);
+    FIELD(0, Count);
+
+    FIELD(1, Buckets);
+
+    // pointer to the value stored for key, or nullptr if key is not
+    // present. only valid until the next allocation.
+    static Primitive* Find(Map* self, Primitive key);
+
+    static void Insert(Heap* heap, Handle self, Handle key, Handle value);
+
+    // false if key was not present
+    static bool Remove(Map* self, Primitive key);
+
+    static std::uint64_t Hash(Primitive key);
+
+    static bool KeyEquals(Primitive k1, Primitive k2);
 };
 
 static_assert(sizeof(Map) == sizeof(Object));
 
-#endif // MAP_HH__
\ No newline at end of file
+#endif // MAP_HH__
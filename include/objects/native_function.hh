@@ -3,15 +3,18 @@
 
 #include "structure.hh"
 
-using NativeFunctionPointer = void (*)();
+class VirtualMachine;
+
+using NativeFunctionPointer = Handle (*)(VirtualMachine* vm, const std::vector<Handle>& args);
 
 class NativeFunction : public Structure<Object::Type::NativeFunction, 2> {
 public:
-    NativeFunction(Handle _ptr, Handle _arity);
+    NativeFunction(Handle _index, Handle _arity);
 
-    FIELD(0, Pointer);
+    // Integer index into the virtual machine's native function table
+    FIELD(0, Index);
 
     FIELD(1, Arity);
 };
 
-#endif // NATIVE_FN_HH__
\ No newline at end of file
+#endif // NATIVE_FN_HH__
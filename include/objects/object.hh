@@ -19,13 +19,26 @@ class SlotIterator;
     V(Pair) \
     V(Vector) \
     V(String) \
+    V(Rope) \
     V(Map) \
     V(Stack) \
     V(Envrionment) \
     V(Frame) \
     V(NativeFunction) \
     V(Lambda) \
-    V(Continuation)
+    V(Continuation) \
+    V(Cell) \
+    V(Box) \
+    V(PersistentMap) \
+    V(PersistentVector) \
+    V(EqHashtable) \
+    V(RecordType) \
+    V(Record) \
+    V(GrowableVector) \
+    V(StringBuilder) \
+    V(Code) \
+    V(EscapeContinuation) \
+    V(Prompt)
 
 #define FORWARD_DECLARE(v) class v;
 PER_CONCRETE_OBJECT_TYPE(FORWARD_DECLARE)
@@ -40,10 +53,23 @@ PER_CONCRETE_OBJECT_TYPE(FORWARD_DECLARE)
                 Environment - representings the envrionment
                 Frame - invocation frame
                 NativeFunction - object that holds metadata and pointer to native function 
-                Lambda - closure of function including created envrionment
+                Lambda - closure of function and the values it captured
                 Continuation - a continuation of a previous stack frame
+                EscapeContinuation - continuation that can only unwind to a live frame
+                Prompt - delimiter of the continuations captured above it
+                Rope - lazy concatenation or slice of strings
+                Cell - value of a global binding
+                Box - captured variable that is assigned
+                PersistentMap - immutable hash trie, nodes are Vectors
+                PersistentVector - immutable radix trie, nodes are Vectors
+                EqHashtable - hash table keyed by identity
+                RecordType - descriptor of a record type
+                GrowableVector - vector with amortized append, items in a Vector
+                StringBuilder - utf-8 bytes appended into a String buffer
             Vector - scheme vector created with a variable size of elements
+            Record - instance of a record type, one slot per field
         String - string
+        Code - lowered bytecode, instruction bytes and a constant pool
 */
 
 
@@ -57,15 +83,29 @@ public:
         #undef COMMA
     };
 private:
-    Object::Type type;
+    // the type and a cached hash share the first half of the header
+    std::uint32_t type : 8;
+    std::uint32_t hash : 24;
     std::uint32_t allocation_size;
 protected:
+    constexpr static std::uint32_t HASH_MASK = (1 << 24) - 1;
+
     Type GetType() const {
-        return type;
+        return static_cast<Type>(type);
+    }
+
+    // a 24 bit hash cached by the object, 0 if none has been cached yet.
+    // it is part of the header so the collector copies it with the object
+    std::uint32_t CachedHash() const {
+        return hash;
+    }
+
+    void SetCachedHash(std::uint32_t value) {
+        hash = value & HASH_MASK;
     }
 public:
     Object(Object::Type _type, std::uint32_t _allocation_size) 
-    : type{_type}, allocation_size{_allocation_size} 
+    : type{static_cast<std::uint32_t>(_type)}, hash{0}, allocation_size{_allocation_size} 
     {}
 
     ~Object() = default;
@@ -103,6 +143,11 @@ public:
     PER_CONCRETE_OBJECT_TYPE(ADD_CONVERTER)
     #undef ADD_CONVERTER
 
+    #define ADD_PREDICATE(v) \
+        bool Is##v() const { return GetType() == Object::Type::v; }
+    PER_CONCRETE_OBJECT_TYPE(ADD_PREDICATE)
+    #undef ADD_PREDICATE
+
     static std::string TypeToString(Object::Type type) {
         switch (type) {
             #define ADD_CASE(v) case Object::Type::v: return #v;
@@ -112,6 +157,11 @@ public:
         }
     }
 
+    // hash for eq?, assigned on first use and kept in the header so it
+    // survives collections. strings answer their content hash, which is
+    // fine since eq? objects are then still guaranteed to hash the same
+    std::uint32_t IdentityHash();
+
     constexpr static std::size_t RequiredMinAllocationSize() {
         return sizeof(Object) + sizeof(Primitive);
     }
@@ -119,6 +169,16 @@ public:
 protected:
     std::size_t GetAllocationSize() const { return allocation_size; }
 
+    // gives back the end of the allocation. the bytes after the new end
+    // are left unused until the next collection, which is fine since a
+    // collection only walks the copies it made
+    void ShrinkAllocationSize(std::size_t size) {
+        if (size > allocation_size || size < RequiredMinAllocationSize() || size % sizeof(Object) != 0) {
+            throw std::runtime_error{"Invalid allocation size to shrink to"};
+        }
+        allocation_size = size;
+    }
+
 private:
     void checkType(Object::Type expected) const {
         Object::Type actual = GetType();
@@ -131,14 +191,14 @@ private:
         }
     }
 
-    bool IsGcForward() const { return Type() == Object::Type::GcForward; }
+    bool IsGcForward() const { return GetType() == Object::Type::GcForward; }
 
     void SetGcForwardAddress(Object* addr) {
         if (this->allocation_size < sizeof(Object) + sizeof(Primitive)) {
             throw std::runtime_error{"Could not set gc forward on object, too small"};
         }
         Primitive* head = reinterpret_cast<Primitive*>(this);
-        this->type = Object::Type::GcForward;
+        this->type = static_cast<std::uint32_t>(Object::Type::GcForward);
         head[1] = Reference(addr);
     }
 
@@ -156,5 +216,6 @@ private:
 static_assert(sizeof(Object) == sizeof(std::int64_t));
 static_assert(sizeof(Object) == sizeof(Primitive));
 static_assert(sizeof(Object) % 8 == 0);
+static_assert(static_cast<std::uint32_t>(Object::Type::GcForward) <= 0xff);
 
 #endif // OBJECT_HH__
\ No newline at end of file
@@ -0,0 +1,153 @@
+#ifndef OPEN_ADDRESSING_HH__
+#define OPEN_ADDRESSING_HH__
+
+#include "lib/std.hh"
+#include "integer.hh"
+#include "vector.hh"
+#include "heap.hh"
+
+/*
+    Open addressing with linear probing, shared by Map and EqHashtable.
+
+    Table has a Count and a Buckets field, and static Hash and KeyEquals
+    that decide how its keys hash and compare. Hash throws for keys the
+    table does not take.
+
+    Buckets is nil until the first insert, afterwards a Vector holding
+    key, value, key, value, ... for a power of two number of entries. An
+    entry with a nil key is empty, so nil cannot be used as a key. The
+    bucket vector is doubled once it is three quarters full. Removal
+    shifts the following entries back instead of leaving tombstones.
+
+    Only included by the tables themselves, since it needs the heap.
+*/
+template <typename Table>
+class OpenAddressing {
+public:
+    constexpr static std::size_t INITIAL_CAPACITY = 8;
+
+    // pointer to the value stored for key, or nullptr if key is not
+    // present. only valid until the next allocation.
+    static Primitive* Find(Table* self, Primitive key) {
+        std::size_t cap = capacity(self);
+        if (cap == 0) {
+            return nullptr;
+        }
+        Vector* buckets = self->Buckets().AsReference()->Value()->AsVector();
+        std::size_t i = probe(buckets, cap, key);
+        if (buckets->GetItem(Integer(2 * i)).GetType() == Primitive::Type::Nil) {
+            return nullptr;
+        }
+        return buckets->ItemPtr(Integer(2 * i + 1));
+    }
+
+    static void Insert(Heap* heap, Handle self, Handle key, Handle value) {
+        // validates the key before anything is allocated
+        Table::Hash(key.Data());
+
+        std::size_t count = table(self)->Count().AsInteger()->Value();
+        if ((count + 1) * 4 > capacity(table(self)) * 3) {
+            grow(heap, self);
+        }
+
+        Table* t = table(self);
+        Vector* buckets = t->Buckets().AsReference()->Value()->AsVector();
+        std::size_t i = probe(buckets, capacity(t), key.Data());
+
+        if (buckets->GetItem(Integer(2 * i)).GetType() == Primitive::Type::Nil) {
+            buckets->SetItem(Integer(2 * i), key.Data());
+            t->Count() = Integer(count + 1);
+        }
+
+        buckets->SetItem(Integer(2 * i + 1), value.Data());
+    }
+
+    // false if key was not present
+    static bool Remove(Table* self, Primitive key) {
+        std::size_t cap = capacity(self);
+        if (cap == 0) {
+            return false;
+        }
+        Vector* buckets = self->Buckets().AsReference()->Value()->AsVector();
+        std::size_t mask = cap - 1;
+        std::size_t hole = probe(buckets, cap, key);
+        if (buckets->GetItem(Integer(2 * hole)).GetType() == Primitive::Type::Nil) {
+            return false;
+        }
+
+        // move back every following entry whose home is not between the
+        // hole and its current position, so probing never stops early
+        for (std::size_t j = (hole + 1) & mask; ; j = (j + 1) & mask) {
+            Primitive current = buckets->GetItem(Integer(2 * j));
+            if (current.GetType() == Primitive::Type::Nil) {
+                break;
+            }
+            std::size_t home = Table::Hash(current) & mask;
+            bool stays = hole < j ? (hole < home && home <= j) : (hole < home || home <= j);
+            if (stays) {
+                continue;
+            }
+            buckets->SetItem(Integer(2 * hole), current);
+            buckets->SetItem(Integer(2 * hole + 1), buckets->GetItem(Integer(2 * j + 1)));
+            hole = j;
+        }
+
+        buckets->SetItem(Integer(2 * hole), Nil());
+        buckets->SetItem(Integer(2 * hole + 1), Nil());
+        self->Count() = Integer(self->Count().AsInteger()->Value() - 1);
+        return true;
+    }
+
+private:
+    static Table* table(Handle self) {
+        return static_cast<Table*>(self.Data().AsReference()->Value());
+    }
+
+    static std::size_t capacity(Table* self) {
+        if (self->Buckets().GetType() == Primitive::Type::Nil) {
+            return 0;
+        }
+        Vector* buckets = self->Buckets().AsReference()->Value()->AsVector();
+        return buckets->Length().Value() / 2;
+    }
+
+    // index of the entry holding key, or of the empty entry where it belongs
+    static std::size_t probe(Vector* buckets, std::size_t capacity, Primitive key) {
+        std::size_t mask = capacity - 1;
+        for (std::size_t i = Table::Hash(key) & mask; ; i = (i + 1) & mask) {
+            Primitive current = buckets->GetItem(Integer(2 * i));
+            if (current.GetType() == Primitive::Type::Nil || Table::KeyEquals(current, key)) {
+                return i;
+            }
+        }
+    }
+
+    static void grow(Heap* heap, Handle self) {
+        std::size_t old_capacity = capacity(table(self));
+        std::size_t new_capacity = old_capacity == 0 ? INITIAL_CAPACITY : old_capacity * 2;
+
+        DEBUGLN("Growing hash table from " << old_capacity << " to " << new_capacity);
+
+        Handle fresh = heap->NewVector(2 * new_capacity);
+
+        // no allocation below here, so raw pointers stay valid
+        Vector* to = fresh.AsVector();
+
+        if (old_capacity != 0) {
+            Vector* from = table(self)->Buckets().AsReference()->Value()->AsVector();
+            for (std::size_t i = 0; i < old_capacity; i++) {
+                Primitive key = from->GetItem(Integer(2 * i));
+                if (key.GetType() == Primitive::Type::Nil) {
+                    continue;
+                }
+                std::size_t j = probe(to, new_capacity, key);
+                to->SetItem(Integer(2 * j), key);
+                to->SetItem(Integer(2 * j + 1), from->GetItem(Integer(2 * i + 1)));
+            }
+        }
+
+        table(self)->Buckets() = fresh;
+    }
+};
+
+#endif // OPEN_ADDRESSING_HH__
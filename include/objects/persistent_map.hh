@@ -0,0 +1,113 @@
+#ifndef PERSISTENT_MAP_HH__
+#define PERSISTENT_MAP_HH__
+
+#include "lib/std.hh"
+#include "structure.hh"
+#include "integer.hh"
+#include "vector.hh"
+#include "transient.hh"
+
+/*
+    Immutable hash array mapped trie with structural sharing. Keys are
+    hashed and compared like Map keys.
+
+    Nodes are Vectors holding
+        edit    - Integer edit that created the node
+        bitmap  - Integer with a bit set for each of the 32 hash fragments
+                  present at this level, nil for a collision node
+        entries - key, value, key, value, ... in bitmap order. A nil key
+                  means the value is the child node for that fragment
+    Collision nodes hold the keys whose 64 bit hashes are all equal and
+    are searched linearly.
+
+    Find is O(log32 n), Assoc and Dissoc copy one path of nodes. A
+    transient updates the nodes it owns in place and returns itself.
+*/
+class PersistentMap : public Structure<Object::Type::PersistentMap, 3> {
+public:
+    constexpr static std::int64_t BITS = 5;
+    constexpr static std::int64_t MASK = (1 << BITS) - 1;
+    constexpr static std::int64_t HASH_BITS = 64;
+
+    PersistentMap();
+
+    ~PersistentMap() = default;
+
+    FIELD(0, Count);
+
+    // nil while the map is empty
+    FIELD(1, Root);
+
+    // Integer edit of a transient, TransientEdit::NONE when persistent
+    FIELD(2, Edit);
+
+    bool IsTransient() const {
+        return ConstEdit().AsConstInteger()->Value() != TransientEdit::NONE;
+    }
+
+    // pointer to the value stored for key, or nullptr if key is not
+    // present. only valid until the next allocation.
+    static Primitive* Find(PersistentMap* self, Primitive key);
+
+    static Handle Assoc(Heap* heap, Handle self, Handle key, Handle value);
+
+    static Handle Dissoc(Heap* heap, Handle self, Handle key);
+
+    // a transient copy of self, self is left untouched. self must be
+    // persistent, a transient of a transient would share the nodes the
+    // first one still updates in place
+    static Handle Transient(Heap* heap, Handle self);
+
+    // ends the transient, later updates copy again
+    static void Persistent(Handle self);
+
+    // calls visit(key, value) for every entry, in no particular order.
+    // visit must not allocate
+    template <typename F>
+    static void ForEach(PersistentMap* self, F visit) {
+        if (self->Root().GetType() != Primitive::Type::Nil) {
+            forEach(self->Root(), visit);
+        }
+    }
+
+private:
+    template <typename F>
+    static void forEach(Primitive node, F& visit) {
+        Vector* entries = node.AsReference()->Value()->AsVector();
+        std::int64_t count = (entries->Length().Value() - 2) / 2;
+        for (std::int64_t i = 0; i < count; i++) {
+            Primitive key = entries->GetItem(Integer(2 + 2 * i));
+            Primitive value = entries->GetItem(Integer(3 + 2 * i));
+            if (key.GetType() == Primitive::Type::Nil) {
+                forEach(value, visit);
+            } else {
+                visit(key, value);
+            }
+        }
+    }
+
+    // self if it is transient, otherwise a copy of the root to update
+    static Handle editable(Heap* heap, Handle self);
+
+    static Handle newNode(Heap* heap, std::int64_t edit, Primitive bitmap, std::int64_t entries);
+
+    // node itself if the edit owns it, otherwise a copy owned by the edit
+    static Handle ensureEditable(Heap* heap, Handle node, std::int64_t edit);
+
+    static Handle assoc(Heap* heap, std::int64_t edit, Handle node, std::int64_t shift, std::uint64_t hash, Handle key, Handle value, bool* added);
+
+    static Handle dissoc(Heap* heap, std::int64_t edit, Handle node, std::int64_t shift, std::uint64_t hash, Handle key, bool* removed);
+
+    // node holding two entries whose hashes agree below shift
+    static Handle pair(Heap* heap, std::int64_t edit, std::int64_t shift, Handle key1, Handle value1, Handle key2, Handle value2);
+
+    // copy of node with a nil entry inserted at index
+    static Handle insertEntry(Heap* heap, std::int64_t edit, Handle node, Primitive bitmap, std::int64_t index);
+
+    // copy of node without the entry at index, or nil if it was the last
+    static Handle removeEntry(Heap* heap, std::int64_t edit, Handle node, Primitive bitmap, std::int64_t index);
+};
+
+static_assert(sizeof(PersistentMap) == sizeof(Object));
+
+#endif // PERSISTENT_MAP_HH__
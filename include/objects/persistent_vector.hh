@@ -0,0 +1,86 @@
+#ifndef PERSISTENT_VECTOR_HH__
+#define PERSISTENT_VECTOR_HH__
+
+#include "lib/std.hh"
+#include "structure.hh"
+#include "integer.hh"
+#include "vector.hh"
+#include "transient.hh"
+
+/*
+    Immutable vector with structural sharing, a 32 way radix trie plus a
+    tail holding the last up to 32 items.
+
+    Root and Tail are nodes, Vectors whose first item is the Integer edit
+    that created the node followed by WIDTH children or items. Root is nil
+    until the first tail is pushed into the trie and Tail is nil while the
+    vector is empty. Shift is the bit shift of the root level.
+
+    Get is O(log32 n), Set and Push copy one path of at most log32 n nodes.
+    A transient updates the nodes it owns in place and returns itself.
+*/
+class PersistentVector : public Structure<Object::Type::PersistentVector, 5> {
+public:
+    constexpr static std::int64_t BITS = 5;
+    constexpr static std::int64_t WIDTH = 1 << BITS;
+    constexpr static std::int64_t MASK = WIDTH - 1;
+
+    PersistentVector();
+
+    ~PersistentVector() = default;
+
+    FIELD(0, Count);
+
+    FIELD(1, Shift);
+
+    FIELD(2, Root);
+
+    FIELD(3, Tail);
+
+    // Integer edit of a transient, TransientEdit::NONE when persistent
+    FIELD(4, Edit);
+
+    Integer Length() const {
+        return *ConstCount().AsConstInteger();
+    }
+
+    bool IsTransient() const {
+        return ConstEdit().AsConstInteger()->Value() != TransientEdit::NONE;
+    }
+
+    static Primitive Get(PersistentVector* self, Integer index);
+
+    // setting the item at Length() pushes
+    static Handle Set(Heap* heap, Handle self, Integer index, Handle value);
+
+    static Handle Push(Heap* heap, Handle self, Handle value);
+
+    // a transient copy of self, self is left untouched. self must be
+    // persistent, a transient of a transient would share the nodes the
+    // first one still updates in place
+    static Handle Transient(Heap* heap, Handle self);
+
+    // ends the transient, later updates copy again
+    static void Persistent(Handle self);
+
+private:
+    std::int64_t tailOffset() const;
+
+    // self if it is transient, otherwise a copy of the root to update
+    static Handle editable(Heap* heap, Handle self);
+
+    static Handle newNode(Heap* heap, std::int64_t edit);
+
+    // node itself if the edit owns it, otherwise a copy owned by the edit
+    static Handle ensureEditable(Heap* heap, Handle node, std::int64_t edit);
+
+    static Handle setInTrie(Heap* heap, std::int64_t edit, std::int64_t level, Handle node, std::int64_t index, Handle value);
+
+    static Handle pushTail(Heap* heap, std::int64_t edit, std::int64_t count, std::int64_t level, Handle parent, Handle tail);
+
+    static Handle newPath(Heap* heap, std::int64_t edit, std::int64_t level, Handle node);
+};
+
+static_assert(sizeof(PersistentVector) == sizeof(Object));
+
+#endif // PERSISTENT_VECTOR_HH__
@@ -66,7 +66,7 @@ private:
         Symbol- 61 bit unsigned integer, 3 bit tag
         Boolean- represented as integer boolean tag
         Real- 32 bit float, 29 bit buffer, 3 bit tag
-        Character- represented as integer with boolean tag
+        Character- unicode codepoint represented as integer with char tag
         NativeReference - 64 bit pointer, tagged in palce with reference tag, acessed by removing tag
     */
 public:
@@ -107,37 +107,6 @@ public:
     PER_PRIMITIVE_TYPE(DEFINE_CASTERS)
     #undef DEFINE_CASTERS
 
-    /*
-    bool ShallowEquals(const Primitive* other) {
-        if (other->GetType() != this->GetType()) {
-            return false;
-        }
-        struct Visitor : Primitive::Visitor {
-            bool result = false;
-            const Primitive* other;
-
-            Visitor(const Primitive* _other) 
-            : other{_other}
-            {}
-
-            virtual ~Visitor() = default;
-
-            void OnNil(const Primitive* self) override { result = true; }
-            void OnReference(const Primitive* self) override { result = self->GetReference() == other->GetReference(); }
-            void OnCharacter(const Primitive* self) override { result = self->GetCharacter() == other->GetCharacter(); }
-            void OnInteger(const Primitive* self) override { result = self->GetInteger() == other->GetInteger(); }
-            void OnBoolean(const Primitive* self) override { result = self->GetBoolean() == other->GetBoolean(); }
-            void OnReal(const Primitive* self) override { result = self->GetReal() == other->GetReal(); }
-            void OnNativeReference(const Primitive* self) override { result = self->GetNativeReference() == other->GetNativeReference(); }
-            void OnSymbol(const Primitive* self) override { result = self->GetSymbol() == other->GetSymbol(); }
-
-        } visitor(other);
-
-        Visit(visitor);
-
-        return visitor.result;
-    }*/
-
 protected:
     void SetInteger(std::int64_t value) {
         checkSize(value);
@@ -171,12 +140,12 @@ protected:
         return getIntegerData();
     }
 
-    void SetCharacter(char value) {
-        SetInteger(value);
+    void SetCharacter(std::uint32_t codepoint) {
+        SetInteger(static_cast<std::int64_t>(codepoint));
         replaceTag(CHAR_TAG);
     }
 
-    char GetCharacter() const {
+    std::uint32_t GetCharacter() const {
         checkType(Primitive::Type::Character);
         return getIntegerData();
     }
@@ -221,6 +190,11 @@ public:
         return getType();
     }
 
+    // raw tagged representation, equal bits means identical values
+    std::uint64_t Bits() const {
+        return this->_data;
+    }
+
     std::string static TypeToString(Primitive::Type type) {
         switch (type) {
             #define ADD_CASE(v) case Primitive::Type::v: return #v;
@@ -0,0 +1,18 @@
+#ifndef PROMPT_HH__
+#define PROMPT_HH__
+
+#include "structure.hh"
+
+// delimiter put on the frame of a call-with-continuation-prompt call,
+// delimited continuations capture the frames above the nearest one
+class Prompt : public Structure<Object::Type::Prompt, 1> {
+public:
+    Prompt(Handle _tag);
+
+    ~Prompt() = default;
+
+    // compared with eq?
+    FIELD(0, Tag);
+};
+
+#endif // PROMPT_HH__
@@ -0,0 +1,48 @@
+#ifndef RECORD_HH__
+#define RECORD_HH__
+
+#include "lib/std.hh"
+#include "slottedobject.hh"
+#include "integer.hh"
+
+/*
+    Record layout
+        Object header
+        Primitive descriptor - the RecordType the record was made from
+        Primitive fields[]   - one slot per field of the descriptor
+
+    The fields are fixed when the record is made, so a field is always at
+    the same offset and an access only has to compare the descriptor.
+*/
+class Record : public SlottedObject {
+public:
+    Record(std::size_t fields, Handle descriptor);
+
+    ~Record() = default;
+
+    Primitive& Descriptor() { return SlotRef(0); }
+
+    Integer FieldCount() const {
+        return Integer((GetAllocationSize() - MinAllocationSize()) / sizeof(Primitive));
+    }
+
+    Primitive GetField(Integer index) const {
+        return GetSlot(index.Value() + 1);
+    }
+
+    void SetField(Integer index, Primitive val) {
+        SlotRef(index.Value() + 1) = val;
+    }
+
+    static std::size_t AllocationSize(std::size_t fields) {
+        return MinAllocationSize() + sizeof(Primitive) * fields;
+    }
+
+    constexpr static std::size_t MinAllocationSize() {
+        return sizeof(Object) + sizeof(Primitive);
+    }
+};
+
+static_assert(sizeof(Record) == sizeof(Object));
+
+#endif // RECORD_HH__
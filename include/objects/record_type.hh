@@ -0,0 +1,28 @@
+#ifndef RECORD_TYPE_HH__
+#define RECORD_TYPE_HH__
+
+#include "structure.hh"
+#include "integer.hh"
+#include "vector.hh"
+
+// descriptor made by define-record-type, every record points at the
+// descriptor it was made from and accessors check for it by identity
+class RecordType : public Structure<Object::Type::RecordType, 2> {
+public:
+    RecordType(Handle _name, Handle _fields);
+
+    ~RecordType() = default;
+
+    FIELD(0, Name);
+
+    // Vector of the field names, a field's position is its slot in the record
+    FIELD(1, Fields);
+
+    Integer FieldCount() {
+        return Fields().AsReference()->Value()->AsVector()->Length();
+    }
+};
+
+static_assert(sizeof(RecordType) == sizeof(Object));
+
+#endif // RECORD_TYPE_HH__
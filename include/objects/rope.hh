@@ -0,0 +1,90 @@
+#ifndef ROPE_HH__
+#define ROPE_HH__
+
+#include "lib/std.hh"
+#include "structure.hh"
+#include "integer.hh"
+#include "character.hh"
+#include "string.hh"
+
+/*
+    Rope - lazily concatenated or sliced string
+
+    A rope node is either
+        concat - Left and Right are both strings (String or Rope)
+        slice  - Left is the source string and Right is the Integer
+                 offset of the first character within it
+
+    Ropes are flattened on the first random access. Flattening rewrites
+    the node in place into a slice over a freshly allocated String, so
+    the children become garbage and later accesses are O(1).
+
+    Hashing and comparing go over the leaves without copying them, and
+    the hash is cached in the header like the hash of a String. It is
+    the hash of the text, so a rope and a String that read the same hash
+    the same.
+*/
+class Rope : public Structure<Object::Type::Rope, 3> {
+public:
+    // concatenations or slices shorter than this are copied eagerly
+    constexpr static std::int64_t FLAT_LIMIT = 32;
+
+    Rope(Handle _left, Handle _right, Handle _length);
+
+    ~Rope() = default;
+
+    FIELD(0, Left);
+
+    FIELD(1, Right);
+
+    FIELD(2, Length);
+
+    bool IsSlice() const {
+        return ConstRight().GetType() == Primitive::Type::Integer;
+    }
+
+    // all of these accept either a String or a Rope
+
+    static Handle Concat(Heap* heap, Handle left, Handle right);
+
+    static Handle Slice(Heap* heap, Handle source, Integer start, Integer length);
+
+    static Handle Flatten(Heap* heap, Handle str);
+
+    static Integer LengthOf(Primitive str);
+
+    static Character GetChar(Heap* heap, Handle str, Integer index);
+
+    static std::string ToStdString(Primitive str);
+
+    // the same as String::HashBytes of the text, computed once
+    std::uint32_t Hash() const;
+
+    // the utf-8 bytes of a String or a Rope piece by piece, in order.
+    // nothing may allocate while it is in use, since that may move the
+    // strings the pieces are in
+    class Leaves {
+    public:
+        Leaves(Primitive str) : Leaves(str, 0, Rope::LengthOf(str).Value()) {}
+
+        // the codepoints in [start, start + length) of str
+        Leaves(Primitive str, std::int64_t start, std::int64_t length);
+
+        // the next piece, empty once there are no more
+        std::string_view Next();
+
+    private:
+        struct Work {
+            Primitive node;
+            std::int64_t start;
+            std::int64_t length;
+        };
+
+        // explicit work list, repeated appends produce deeply left leaning trees
+        std::vector<Work> work;
+    };
+};
+
+static_assert(sizeof(Rope) == sizeof(Object));
+
+#endif // ROPE_HH__
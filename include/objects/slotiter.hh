@@ -3,15 +3,28 @@
 
 #include "lib/std.hh"
 
+#include "box.hh"
+#include "cell.hh"
+#include "code.hh"
 #include "continuation.hh"
 #include "env.hh"
+#include "eq_hashtable.hh"
+#include "escape_continuation.hh"
 #include "frame.hh"
+#include "growable_vector.hh"
 #include "lambda.hh"
 #include "map.hh"
 #include "native_function.hh"
 #include "object.hh"
 #include "pair.hh"
+#include "persistent_map.hh"
+#include "persistent_vector.hh"
+#include "prompt.hh"
+#include "record.hh"
+#include "record_type.hh"
+#include "rope.hh"
 #include "string.hh"
+#include "string_builder.hh"
 #include "stack.hh"
 #include "vector.hh"
 
@@ -2,35 +2,152 @@
 #define STRING_HH__
 
 #include "lib/std.hh"
+#include "util/utf8.hh"
 #include "object.hh"
 #include "integer.hh"
 #include "character.hh"
 
+/*
+    String layout
+        Object header
+        Primitive length     - number of codepoints
+        Utf8Header           - byte length, flags and the access cursor
+        uint32 breadcrumbs[] - byte offset of every BREADCRUMB_STRIDE'th codepoint,
+                               only reserved for strings that are not pure ascii
+        char bytes[]         - utf-8 encoded contents
+
+    Ascii strings index their bytes directly. Other strings remember where
+    the last access ended, so sequential access is O(1), and build the
+    breadcrumb table on the first access that cannot be served from the
+    cursor, which bounds any random access to BREADCRUMB_STRIDE decodes.
+*/
 class String : public Object {
+friend StringBuilder;
+private:
+    constexpr static std::uint32_t ASCII_ONLY = 0b01;
+    constexpr static std::uint32_t BREADCRUMBS_BUILT = 0b10;
+    constexpr static std::size_t BREADCRUMB_STRIDE = 32;
+
+    struct Utf8Header {
+        std::uint32_t byte_length;
+        std::uint32_t flags;
+        std::uint32_t cursor_index;
+        std::uint32_t cursor_offset;
+    };
+
 public:
     String(const std::string& str): Object(Object::Type::String, AllocationSize(str))
     {
-        *length() = Integer(str.size());
+        std::size_t codepoints = Utf8Length(str);
+        *length() = Integer(codepoints);
+        Utf8Header* h = header();
+        h->byte_length = str.size();
+        h->flags = codepoints == str.size() ? ASCII_ONLY : 0;
+        h->cursor_index = 0;
+        h->cursor_offset = 0;
         char* dest = chars();
         for (std::size_t i = 0; i < str.size(); i++) {
             dest[i] = str.at(i);
         }
     }
 
-    Integer Length() const { 
-        return *this->length()->AsConstInteger(); 
+    // an empty string with room for capacity bytes, StringBuilder
+    // appends into the room and finishes the buffer in place
+    explicit String(std::size_t capacity): Object(Object::Type::String, BufferAllocationSize(capacity))
+    {
+        *length() = Integer(0);
+        Utf8Header* h = header();
+        h->byte_length = 0;
+        h->flags = ASCII_ONLY;
+        h->cursor_index = 0;
+        h->cursor_offset = 0;
+    }
+
+    Integer Length() const {
+        return *this->length()->AsConstInteger();
+    }
+
+    Integer ByteLength() const {
+        return Integer(header()->byte_length);
+    }
+
+    bool IsAscii() const {
+        return (header()->flags & ASCII_ONLY) != 0;
     }
 
     Character GetChar(Integer index) const {
-        if (index.Value() >= Length().Value()) {
+        if (index.Value() < 0 || index.Value() >= Length().Value()) {
             throw std::runtime_error{"String index out of bounds"};
         }
         char* c = chars();
-        return Character(c[index.Value()]);
+        if (IsAscii()) {
+            return Character(static_cast<unsigned char>(c[index.Value()]));
+        }
+        std::size_t offset = byteOffset(index.Value());
+        std::size_t consumed = 0;
+        std::uint32_t codepoint = Utf8Decode(&c[offset], header()->byte_length - offset, &consumed);
+        Utf8Header* h = header();
+        h->cursor_index = index.Value() + 1;
+        h->cursor_offset = offset + consumed;
+        return Character(codepoint);
+    }
+
+    // utf-8 bytes of the codepoints in [start, start + count)
+    std::string Substring(Integer start, Integer count) const {
+        return std::string(SubstringView(start, count));
+    }
+
+    // like Substring without the copy, only valid until the next
+    // allocation, which may move the string
+    std::string_view SubstringView(Integer start, Integer count) const {
+        if (start.Value() < 0 || count.Value() < 0 || start.Value() + count.Value() > Length().Value()) {
+            throw std::runtime_error{"String substring out of bounds"};
+        }
+        std::size_t begin = byteOffset(start.Value());
+        std::size_t end = byteOffset(start.Value() + count.Value());
+        return std::string_view(&chars()[begin], end - begin);
+    }
+
+    std::string ToStdString() const {
+        return std::string(chars(), header()->byte_length);
+    }
+
+    // hash of the contents, strings are immutable so it is computed once
+    // and cached in the object header
+    std::uint32_t Hash() const {
+        std::uint32_t cached = CachedHash();
+        if (cached != 0) {
+            return cached;
+        }
+        std::uint32_t computed = HashBytes(chars(), header()->byte_length);
+        const_cast<String*>(this)->SetCachedHash(computed);
+        return computed;
+    }
+
+    // fnv-1a folded to the 24 bits of the header, never 0
+    static std::uint32_t HashBytes(const char* bytes, std::size_t length) {
+        return HashFold(HashMore(HASH_SEED, bytes, length));
+    }
+
+    // HashBytes in pieces, for text that is not in one place. starting
+    // from HASH_SEED and folding the end gives the same hash
+    constexpr static std::uint64_t HASH_SEED = 0xcbf29ce484222325ULL;
+
+    static std::uint64_t HashMore(std::uint64_t h, const char* bytes, std::size_t length) {
+        for (std::size_t i = 0; i < length; i++) {
+            h ^= static_cast<unsigned char>(bytes[i]);
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    static std::uint32_t HashFold(std::uint64_t h) {
+        std::uint32_t folded = (h ^ (h >> 24) ^ (h >> 48)) & HASH_MASK;
+        return folded == 0 ? 1 : folded;
     }
 
     constexpr static std::size_t MinAllocationSize() {
-        return sizeof(Object) + sizeof(Primitive);
+        return sizeof(Object) + sizeof(Primitive) + sizeof(Utf8Header);
     }
 
     bool HasNext(std::size_t i) const {
@@ -44,7 +161,16 @@ public:
     static std::size_t AllocationSize(const std::string& str) {
         DEBUGLN("String size is " << str.size());
         std::size_t string_bytes = str.size() * sizeof(char) + MinAllocationSize();
+        string_bytes += breadcrumbCount(Utf8Length(str), str.size()) * sizeof(std::uint32_t);
         DEBUGLN("Unaligned allocation size is " << string_bytes);
+        return align(string_bytes);
+    }
+
+    static std::size_t BufferAllocationSize(std::size_t capacity) {
+        return align(MinAllocationSize() + capacity);
+    }
+private:
+    static std::size_t align(std::size_t string_bytes) {
         if (string_bytes % sizeof(Object) != 0) {
             // round up to alignment
             DEBUGLN("Rounding up to next alignment before: " << string_bytes);
@@ -53,20 +179,94 @@ public:
         }
         return string_bytes;
     }
-private:
+
+    static std::size_t breadcrumbCount(std::size_t codepoints, std::size_t bytes) {
+        if (codepoints == bytes || codepoints == 0) {
+            return 0;
+        }
+        return (codepoints - 1) / BREADCRUMB_STRIDE;
+    }
+
+    std::size_t byteOffset(std::size_t index) const {
+        Utf8Header* h = header();
+
+        if (IsAscii()) {
+            return index;
+        }
+
+        if (index == static_cast<std::size_t>(Length().Value())) {
+            return h->byte_length;
+        }
+
+        std::size_t current_index = 0;
+        std::size_t current_offset = 0;
+
+        bool cursor_usable = h->cursor_index <= index && index - h->cursor_index < BREADCRUMB_STRIDE;
+
+        if (cursor_usable) {
+            current_index = h->cursor_index;
+            current_offset = h->cursor_offset;
+        } else {
+            if ((h->flags & BREADCRUMBS_BUILT) == 0) {
+                buildBreadcrumbs();
+            }
+            std::size_t crumb = index / BREADCRUMB_STRIDE;
+            if (crumb > 0) {
+                current_index = crumb * BREADCRUMB_STRIDE;
+                current_offset = breadcrumbs()[crumb - 1];
+            }
+        }
+
+        const char* c = chars();
+        while (current_index < index) {
+            current_offset += Utf8SequenceLength(static_cast<unsigned char>(c[current_offset]));
+            current_index += 1;
+        }
+
+        return current_offset;
+    }
+
+    void buildBreadcrumbs() const {
+        DEBUGLN("Building utf-8 breadcrumbs for string of length " << Length().Value());
+        Utf8Header* h = header();
+        std::uint32_t* crumbs = breadcrumbs();
+        const char* c = chars();
+        std::size_t offset = 0;
+        std::size_t count = breadcrumbCount(Length().Value(), h->byte_length);
+        for (std::size_t crumb = 1; crumb <= count; crumb++) {
+            for (std::size_t i = 0; i < BREADCRUMB_STRIDE; i++) {
+                offset += Utf8SequenceLength(static_cast<unsigned char>(c[offset]));
+            }
+            crumbs[crumb - 1] = offset;
+        }
+        h->flags |= BREADCRUMBS_BUILT;
+    }
+
     Primitive* length() const {
         const Primitive* const_head = reinterpret_cast<const Primitive*>(this);
         Primitive* head = const_cast<Primitive*>(const_head);
         return &head[1];
     }
 
-    char* chars() const {
+    Utf8Header* header() const {
         const char* data = reinterpret_cast<const char*>(this);
         char* result = const_cast<char*>(data);
-        return &result[MinAllocationSize()];
+        return reinterpret_cast<Utf8Header*>(&result[sizeof(Object) + sizeof(Primitive)]);
+    }
+
+    std::uint32_t* breadcrumbs() const {
+        const char* data = reinterpret_cast<const char*>(this);
+        char* result = const_cast<char*>(data);
+        return reinterpret_cast<std::uint32_t*>(&result[MinAllocationSize()]);
+    }
+
+    char* chars() const {
+        std::size_t crumbs = breadcrumbCount(Length().Value(), header()->byte_length);
+        char* result = reinterpret_cast<char*>(breadcrumbs());
+        return &result[crumbs * sizeof(std::uint32_t)];
     }
 };
 
 static_assert(sizeof(String) == sizeof(Object));
 
-#endif // STRING_HH__
\ No newline at end of file
+#endif // STRING_HH__
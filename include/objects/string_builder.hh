@@ -0,0 +1,59 @@
+#ifndef STRING_BUILDER_HH__
+#define STRING_BUILDER_HH__
+
+#include "lib/std.hh"
+#include "structure.hh"
+#include "integer.hh"
+#include "string.hh"
+
+/*
+    Accumulates utf-8 text in amortized linear time.
+
+    Buffer is nil until the first append, afterwards a String made with
+    room to spare. The buffer stays an empty string while the builder owns
+    it and the appended bytes sit in its room, whose size doubles when it
+    runs out. Count is the number of bytes appended and Length the number
+    of codepoints.
+
+    Finish hands out the buffer itself when the text is ascii, by filling
+    in its header and shrinking it to fit, so the text is not copied a
+    final time. Other text is copied into a new String, which needs room
+    for its breadcrumbs in front of the bytes. The builder is empty again
+    afterwards.
+*/
+class StringBuilder : public Structure<Object::Type::StringBuilder, 3> {
+public:
+    constexpr static std::size_t INITIAL_CAPACITY = 32;
+
+    StringBuilder();
+
+    ~StringBuilder() = default;
+
+    FIELD(0, Count);
+
+    FIELD(1, Length);
+
+    FIELD(2, Buffer);
+
+    // appends a String, Rope or Character
+    static void Append(Heap* heap, Handle self, Handle value);
+
+    static Handle Finish(Heap* heap, Handle self);
+
+private:
+    static std::size_t capacity(StringBuilder* self);
+
+    static char* bytes(StringBuilder* self);
+
+    // makes room for count more bytes and returns where they go, only
+    // valid until the next allocation
+    static char* reserve(Heap* heap, Handle self, std::size_t count);
+
+    static void appendBytes(Heap* heap, Handle self, const std::string& text);
+
+    static void reset(StringBuilder* self);
+};
+
+static_assert(sizeof(StringBuilder) == sizeof(Object));
+
+#endif // STRING_BUILDER_HH__
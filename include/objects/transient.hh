@@ -0,0 +1,31 @@
+#ifndef TRANSIENT_HH__
+#define TRANSIENT_HH__
+
+#include "lib/std.hh"
+
+/*
+    Edits of the persistent collections.
+
+    Every node of a PersistentMap or PersistentVector records the edit that
+    created it, edit NONE for nodes built by persistent operations. A
+    transient gets a fresh edit and may update the nodes recording its own
+    edit in place, any other node is copied first. Edits are never reused,
+    so once a transient is made persistent again nothing can modify the
+    nodes it created. Only a persistent collection can be made transient,
+    otherwise two transients would own the same nodes.
+*/
+class TransientEdit {
+public:
+    constexpr static std::int64_t NONE = 0;
+
+    static std::int64_t Next() {
+        static std::atomic<std::int64_t> next{1};
+        return next.fetch_add(1);
+    }
+
+    static bool Owns(std::int64_t edit, std::int64_t node_edit) {
+        return edit != NONE && edit == node_edit;
+    }
+};
+
+#endif // TRANSIENT_HH__
@@ -3,6 +3,7 @@
 
 #include "lib/std.hh"
 #include "slottedobject.hh"
+#include "integer.hh"
 
 class Vector : public SlottedObject {
 public:
@@ -20,6 +21,10 @@ public:
         SlotRef(index.Value() + 1) = val;
     }
 
+    Primitive* ItemPtr(Integer index) {
+        return SlotPtr(index.Value() + 1);
+    }
+
     static std::size_t AllocationSize(std::size_t items) {
         return MinAllocationSize() + sizeof(Primitive) * items;
     }
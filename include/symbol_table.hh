@@ -3,54 +3,407 @@
 
 #include "lib.hh"
 #include "objects/symbol.hh"
+#include "well_known_symbols.hh"
+#include "util/debug.hh"
 #include "util/memory_semantic_macros.hh"
 
+// bump allocator for symbol names, storage is never moved or freed
+// until the arena itself is destroyed
+class SymbolArena {
+private:
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::size_t block_used = BLOCK_SIZE;
+public:
+    SymbolArena() = default;
+
+    ~SymbolArena() = default;
+
+    NOT_COPYABLE(SymbolArena);
+
+    NOT_MOVEABLE(SymbolArena);
+
+    std::string_view Copy(std::string_view value) {
+        // a fresh arena has no block to point into
+        if (value.empty()) {
+            return std::string_view{};
+        }
+        if (value.size() > BLOCK_SIZE) {
+            // goes in front of the partially used block, the block at the
+            // end is always the one being filled
+            auto at = blocks.insert(blocks.end() - (blocks.empty() ? 0 : 1), std::make_unique<char[]>(value.size()));
+            std::memcpy(at->get(), value.data(), value.size());
+            return std::string_view{at->get(), value.size()};
+        }
+        if (block_used + value.size() > BLOCK_SIZE) {
+            blocks.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+            block_used = 0;
+        }
+        char* dest = &blocks.back()[block_used];
+        std::memcpy(dest, value.data(), value.size());
+        block_used += value.size();
+        return std::string_view{dest, value.size()};
+    }
+
+    void Swap(SymbolArena& other) {
+        blocks.swap(other.blocks);
+        std::swap(block_used, other.block_used);
+    }
+};
+
+/*
+    Symbols are interned into one of SHARD_COUNT open addressing tables,
+    chosen by the hash of the name, so interning different names rarely
+    contends on the same lock. Lookups of already interned names only take
+    the shard lock shared.
+
+    Ids are handed out from a single atomic counter and published into a
+    chunked id -> name table, so ToString never locks.
+
+    The ids in WellKnownSymbols are reserved when the table is constructed.
+
+    The heap reports every symbol it finds in live objects during a
+    collection through BeginMarking, Mark and Sweep. Symbols that were not
+    marked are removed, and their ids and name slots are reused by later
+    interns. Sweep must not run concurrently with Intern or ToString.
+
+    Marks are not combined across heaps, so a table belongs to the one
+    heap that reports to it, and Attach rejects a second one. Sweep would
+    otherwise reclaim every symbol that only the other heap still uses.
+    Several vms may intern into one table concurrently, which is what the
+    sharding is for, but then none of their heaps may be given the table
+    and its symbols are never reclaimed.
+
+    Sweep also compacts the arena of a shard once enough of it is dead,
+    which moves every name of that shard and frees the old storage. A view
+    from ToString is only valid until the next collection, that is until
+    anything allocates on the heap. Copy the name into a std::string to
+    keep it any longer. Every caller in the tree streams or compares the
+    view straight away.
+*/
 class SymbolTable {
 private:
-    std::map<std::string, std::uint64_t> symbols_to_id;
-    std::map<std::uint64_t, std::string> id_to_symbols;
-    std::mutex mutex;
+    static constexpr std::size_t SHARD_COUNT = 16;
+    static constexpr std::size_t CHUNK_SIZE = 4096;
+    static constexpr std::size_t MAX_CHUNKS = 4096;
+    static constexpr std::uint64_t EMPTY = std::numeric_limits<std::uint64_t>::max();
+
+    struct Entry {
+        std::uint64_t hash;
+        std::uint64_t id;
+    };
+
+    struct Shard {
+        std::shared_mutex mutex;
+        std::vector<Entry> entries;
+        std::size_t count = 0;
+        SymbolArena arena;
+        // stable storage for the views published in the id table
+        std::deque<std::string_view> names;
+        std::vector<std::string_view*> free_names;
+        std::size_t live_bytes = 0;
+        std::size_t dead_bytes = 0;
+    };
+
+    using Chunk = std::array<std::atomic<const std::string_view*>, CHUNK_SIZE>;
+
+    std::array<Shard, SHARD_COUNT> shards;
+    std::array<std::atomic<Chunk*>, MAX_CHUNKS> chunks;
+    std::atomic<std::uint64_t> next_id;
+    std::atomic<std::uint64_t> live;
+
+    std::mutex free_ids_mutex;
+    std::vector<std::uint64_t> free_ids;
+    std::atomic<std::size_t> free_ids_count;
+
+    // the heap marking and sweeping the table, if any
+    const void* owner = nullptr;
+    std::vector<std::uint64_t> marks;
+    std::uint64_t reclaimed = 0;
+    std::uint64_t collections = 0;
 public:
-    SymbolTable() {}
+    struct Statistics {
+        std::uint64_t size;        // symbols currently interned
+        std::uint64_t high_water;  // largest id ever handed out plus one
+        std::uint64_t free_ids;    // reclaimed ids waiting to be reused
+        std::uint64_t reclaimed;   // symbols reclaimed over the table's lifetime
+        std::uint64_t collections; // number of sweeps
+    };
+
+    SymbolTable() : next_id{0}, live{0}, free_ids_count{0} {
+        for (std::atomic<Chunk*>& chunk : chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+        for (Shard& shard : shards) {
+            shard.entries.resize(64, Entry{0, EMPTY});
+        }
+        for (std::uint64_t id = 0; id < WellKnownSymbols::COUNT; id++) {
+            if (Intern(WellKnownSymbols::NAMES[id]).Value() != id) {
+                throw std::runtime_error{"Well known symbol was not assigned its reserved id"};
+            }
+        }
+    }
 
-    ~SymbolTable() = default;
+    ~SymbolTable() {
+        for (std::atomic<Chunk*>& chunk : chunks) {
+            delete chunk.load(std::memory_order_relaxed);
+        }
+    }
 
     NOT_COPYABLE(SymbolTable);
 
     NOT_MOVEABLE(SymbolTable);
 
-    Symbol Intern(const std::string & value) {
+    Symbol Intern(std::string_view value) {
+        std::uint64_t hash = std::hash<std::string_view>{}(value);
+        Shard& shard = shards[(hash >> 32) % SHARD_COUNT];
+
+        {
+            std::shared_lock lock{shard.mutex};
+            std::uint64_t found = find(shard, hash, value);
+            if (found != EMPTY) {
+                return Symbol(found);
+            }
+        }
 
-        std::scoped_lock lock{mutex};
+        std::unique_lock lock{shard.mutex};
 
-        auto iter = this->symbols_to_id.find(value);
+        // somebody else may have interned it while we were unlocked
+        std::uint64_t found = find(shard, hash, value);
+        if (found != EMPTY) {
+            return Symbol(found);
+        }
 
-        if (iter != this->symbols_to_id.end()) {
-            return iter->second;
+        if ((shard.count + 1) * 2 > shard.entries.size()) {
+            grow(shard);
         }
 
-        std::uint64_t result = static_cast<std::uint64_t>(this->symbols_to_id.size());
+        std::uint64_t result = allocateId();
 
-        this->symbols_to_id[value] = result;
-        this->id_to_symbols[result] = value;
+        std::string_view* name = nullptr;
+        if (shard.free_names.empty()) {
+            shard.names.push_back(shard.arena.Copy(value));
+            name = &shard.names.back();
+        } else {
+            name = shard.free_names.back();
+            shard.free_names.pop_back();
+            *name = shard.arena.Copy(value);
+        }
+
+        publish(result, name);
+        insert(shard.entries, Entry{hash, result});
+        shard.count += 1;
+        shard.live_bytes += value.size();
+        live.fetch_add(1);
 
         return Symbol(result);
     }
 
-    const std::string ToString(Symbol symbol_id) {
-
-        std::scoped_lock lock{mutex};
+    // the view is invalidated by the next Sweep, see the class comment
+    std::string_view ToString(Symbol symbol_id) const {
+        std::uint64_t id = symbol_id.Value();
+        const std::string_view* name = nullptr;
 
-        auto iter = this->id_to_symbols.find(symbol_id.Value());
+        if (id < CHUNK_SIZE * MAX_CHUNKS) {
+            Chunk* chunk = chunks[id / CHUNK_SIZE].load(std::memory_order_acquire);
+            if (chunk != nullptr) {
+                name = (*chunk)[id % CHUNK_SIZE].load(std::memory_order_acquire);
+            }
+        }
 
-        if (iter == this->id_to_symbols.end()) {
+        if (name == nullptr) {
             std::string error_message{"No symbol definition found for "};
-            error_message.append(std::to_string(symbol_id.Value()));
+            error_message.append(std::to_string(id));
             throw std::runtime_error{error_message};
         }
 
-        return iter->second;
+        return *name;
+    }
+
+    // called by the heap that reports its symbols to the table
+    void Attach(const void* heap) {
+        if (owner != nullptr && owner != heap) {
+            throw std::runtime_error{"Symbol table already belongs to another heap"};
+        }
+        owner = heap;
+    }
+
+    void BeginMarking() {
+        marks.assign((next_id.load() + 63) / 64, 0);
+    }
+
+    void Mark(Symbol symbol) {
+        std::uint64_t id = symbol.Value();
+        if (id / 64 < marks.size()) {
+            marks[id / 64] |= std::uint64_t{1} << (id % 64);
+        }
+    }
+
+    void Sweep() {
+        for (Shard& shard : shards) {
+            std::unique_lock lock{shard.mutex};
+
+            std::vector<Entry> kept(shard.entries.size(), Entry{0, EMPTY});
+            for (const Entry& entry : shard.entries) {
+                if (entry.id == EMPTY) {
+                    continue;
+                }
+                if (isMarked(entry.id)) {
+                    insert(kept, entry);
+                } else {
+                    reclaim(shard, entry.id);
+                }
+            }
+            shard.entries.swap(kept);
+
+            if (shard.dead_bytes > shard.live_bytes && shard.dead_bytes >= COMPACT_THRESHOLD) {
+                compact(shard);
+            }
+        }
+
+        marks.clear();
+        collections += 1;
+
+        DEBUGLN("Symbol table swept, " << live.load() << " live, " << reclaimed << " reclaimed in total");
+    }
+
+    Statistics GetStatistics() {
+        std::scoped_lock lock{free_ids_mutex};
+        return Statistics{
+            live.load(),
+            next_id.load(),
+            free_ids.size(),
+            reclaimed,
+            collections,
+        };
+    }
+
+private:
+    static constexpr std::size_t COMPACT_THRESHOLD = 64 * 1024;
+
+    std::uint64_t allocateId() {
+        if (free_ids_count.load() > 0) {
+            std::scoped_lock lock{free_ids_mutex};
+            if (!free_ids.empty()) {
+                std::uint64_t id = free_ids.back();
+                free_ids.pop_back();
+                free_ids_count.store(free_ids.size());
+                return id;
+            }
+        }
+        return next_id.fetch_add(1);
+    }
+
+    bool isMarked(std::uint64_t id) const {
+        if (id < WellKnownSymbols::COUNT) {
+            return true;
+        }
+        // interned after marking began
+        if (id / 64 >= marks.size()) {
+            return true;
+        }
+        return (marks[id / 64] & (std::uint64_t{1} << (id % 64))) != 0;
+    }
+
+    std::string_view* nameSlot(std::uint64_t id) const {
+        Chunk* chunk = chunks[id / CHUNK_SIZE].load(std::memory_order_acquire);
+        const std::string_view* name = (*chunk)[id % CHUNK_SIZE].load(std::memory_order_acquire);
+        return const_cast<std::string_view*>(name);
+    }
+
+    void reclaim(Shard& shard, std::uint64_t id) {
+        std::string_view* name = nameSlot(id);
+
+        shard.live_bytes -= name->size();
+        shard.dead_bytes += name->size();
+        shard.free_names.push_back(name);
+        shard.count -= 1;
+
+        publish(id, nullptr);
+
+        {
+            std::scoped_lock lock{free_ids_mutex};
+            free_ids.push_back(id);
+            free_ids_count.store(free_ids.size());
+        }
+
+        live.fetch_sub(1);
+        reclaimed += 1;
+    }
+
+    // copies the live names of a shard into a fresh arena, dropping the
+    // storage of reclaimed names
+    static void compact(Shard& shard) {
+        DEBUGLN("Compacting symbol arena with " << shard.dead_bytes << " dead bytes");
+        SymbolArena fresh;
+        std::set<std::string_view*> free{shard.free_names.begin(), shard.free_names.end()};
+        for (std::string_view& name : shard.names) {
+            if (free.count(&name) == 0) {
+                name = fresh.Copy(name);
+            } else {
+                name = std::string_view{};
+            }
+        }
+        shard.arena.Swap(fresh);
+        shard.dead_bytes = 0;
+    }
+
+    std::uint64_t find(const Shard& shard, std::uint64_t hash, std::string_view value) const {
+        std::size_t mask = shard.entries.size() - 1;
+        for (std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+            const Entry& entry = shard.entries[i];
+            if (entry.id == EMPTY) {
+                return EMPTY;
+            }
+            if (entry.hash == hash && ToString(Symbol(entry.id)) == value) {
+                return entry.id;
+            }
+        }
+    }
+
+    static void insert(std::vector<Entry>& entries, Entry entry) {
+        std::size_t mask = entries.size() - 1;
+        for (std::size_t i = entry.hash & mask; ; i = (i + 1) & mask) {
+            if (entries[i].id == EMPTY) {
+                entries[i] = entry;
+                return;
+            }
+        }
+    }
+
+    static void grow(Shard& shard) {
+        std::vector<Entry> larger(shard.entries.size() * 2, Entry{0, EMPTY});
+        for (const Entry& entry : shard.entries) {
+            if (entry.id != EMPTY) {
+                insert(larger, entry);
+            }
+        }
+        shard.entries.swap(larger);
+    }
+
+    void publish(std::uint64_t id, const std::string_view* name) {
+        if (id >= CHUNK_SIZE * MAX_CHUNKS) {
+            throw std::runtime_error{"Symbol table is full"};
+        }
+
+        std::atomic<Chunk*>& slot = chunks[id / CHUNK_SIZE];
+        Chunk* chunk = slot.load(std::memory_order_acquire);
+
+        if (chunk == nullptr) {
+            Chunk* fresh = new Chunk();
+            for (std::atomic<const std::string_view*>& entry : *fresh) {
+                entry.store(nullptr, std::memory_order_relaxed);
+            }
+            if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+                chunk = fresh;
+            } else {
+                // lost the race, chunk now holds the winner
+                delete fresh;
+            }
+        }
+
+        (*chunk)[id % CHUNK_SIZE].store(name, std::memory_order_release);
     }
 };
 
-#endif // SYMBOL_TABLE_H__
\ No newline at end of file
+#endif // SYMBOL_TABLE_H__
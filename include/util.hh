@@ -3,5 +3,6 @@
 
 #include "util/debug.hh"
 #include "util/memory_semantic_macros.hh"
+#include "util/utf8.hh"
 
 #endif // UTIL_MOD_HH__
\ No newline at end of file
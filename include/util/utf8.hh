@@ -0,0 +1,70 @@
+#ifndef UTF8_HH__
+#define UTF8_HH__
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+// number of bytes in the sequence started by lead, throws on a continuation
+// byte or an invalid lead byte
+inline std::size_t Utf8SequenceLength(unsigned char lead) {
+    if (lead < 0x80) { return 1; }
+    if ((lead & 0xE0) == 0xC0) { return 2; }
+    if ((lead & 0xF0) == 0xE0) { return 3; }
+    if ((lead & 0xF8) == 0xF0) { return 4; }
+    throw std::runtime_error{"Invalid utf-8 lead byte"};
+}
+
+// decodes the codepoint at bytes, which must hold at least available bytes
+inline std::uint32_t Utf8Decode(const char* bytes, std::size_t available, std::size_t* consumed) {
+    unsigned char lead = static_cast<unsigned char>(bytes[0]);
+    std::size_t n = Utf8SequenceLength(lead);
+    if (n > available) {
+        throw std::runtime_error{"Truncated utf-8 sequence"};
+    }
+    std::uint32_t codepoint = n == 1 ? lead : lead & (0x7F >> n);
+    for (std::size_t i = 1; i < n; i++) {
+        unsigned char next = static_cast<unsigned char>(bytes[i]);
+        if ((next & 0xC0) != 0x80) {
+            throw std::runtime_error{"Invalid utf-8 continuation byte"};
+        }
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+    *consumed = n;
+    return codepoint;
+}
+
+inline void Utf8Encode(std::uint32_t codepoint, std::string& out) {
+    if (codepoint < 0x80) {
+        out.push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x110000) {
+        out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else {
+        throw std::runtime_error{"Codepoint out of range"};
+    }
+}
+
+// number of codepoints in a utf-8 encoded string, validating as it goes
+inline std::size_t Utf8Length(const std::string& str) {
+    std::size_t count = 0;
+    std::size_t i = 0;
+    while (i < str.size()) {
+        std::size_t consumed = 0;
+        Utf8Decode(&str[i], str.size() - i, &consumed);
+        i += consumed;
+        count += 1;
+    }
+    return count;
+}
+
+#endif // UTF8_HH__
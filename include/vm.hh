@@ -6,175 +6,1605 @@
 #include "objects.hh"
 #include "heap.hh"
 #include "symbol_table.hh"
+#include "assembler.hh"
+#include "call_stack.hh"
+#include "jit.hh"
 
-#define PER_OPCODE(V) \
-    V(load) \
-    V(define) \
-    V(set) \
-    V(invoke) \
-    V(lambda) \
-    V(literal) \
-    V(pop) \
-    V(invoketail) \
-    V(jumpiffalse) \
-    V(jump) \
-    V(return)
+// dispatch with computed goto where the compiler supports it, building
+// with FLANG_SWITCH_DISPATCH forces the portable switch
+#if defined(__GNUC__) && !defined(FLANG_SWITCH_DISPATCH)
+#define FLANG_THREADED_DISPATCH 1
+#else
+#define FLANG_THREADED_DISPATCH 0
+#endif
+
+#define PER_INTEGER_ARITHMETIC_NATIVE(V) \
+    V(add, "+", +) \
+    V(subtract, "-", -) \
+    V(multiply, "*", *)
+
+#define PER_INTEGER_COMPARISON_NATIVE(V) \
+    V(equals, "=", ==) \
+    V(less, "<", <) \
+    V(greater, ">", >)
 
 class VirtualMachine {
+    struct Registers;
+    // natives that take over the running call instead of returning a
+    // value, they get the operand stack offset of the receiver
+    using ControlFunctionPointer = void (VirtualMachine::*)(Registers& r, std::size_t first, std::size_t argc);
+
     Heap heap;
     SymbolTable symbol_table;
     Handle global_env;
-    #define DEFINE_SYMBOL_FOR_OPCODE(V) Primitive symbol_##V;
-    PER_OPCODE(DEFINE_SYMBOL_FOR_OPCODE)
-    #undef DEFINE_SYMBOL_FOR_OPCODE
+    Handle result;
+    std::vector<NativeFunctionPointer> natives;
+    // indexed like natives, null for the natives that return a value
+    std::vector<ControlFunctionPointer> controls;
+    // indexed like natives, the quickened invoke of the natives that have
+    // one and invoke for the others
+    std::vector<std::uint8_t> quickenings;
+    CallStack frames;
+    // heap frames the bottom of the call stack returns into, the rest of
+    // the last continuation captured or resumed
+    Handle underflow;
+    // slots of the frames whose locals have not escaped, pushed on invoke
+    // and popped on return. a frame using it holds its base offset as an
+    // Integer in place of an environment
+    std::vector<Primitive> locals;
+    // operand stack shared by every frame, a frame holds the offset its
+    // temps start at as an Integer in place of a Stack
+    std::vector<Primitive> temps;
+#if FLANG_JIT
+    // machine code by the Code it was compiled from, followed across
+    // collections. the machine code of a Code that died is retired, and
+    // only freed once no machine code runs, since a return or a tail call
+    // may drop the last reference to the code it runs from
+    struct Compiled {
+        Code* owner;
+        std::unique_ptr<JitCode> native;
+    };
+    std::vector<Compiled> compiled;
+    std::vector<std::unique_ptr<JitCode>> retired;
+    class CompiledSweeper : public Heap::GcObserver {
+    public:
+        CompiledSweeper(VirtualMachine* _vm) : vm{_vm} {}
+
+        void AfterGc() override {
+            vm->sweepCompiled();
+        }
+
+    private:
+        VirtualMachine* vm;
+    };
+    CompiledSweeper sweeper{this};
+    // thrown by a handler the machine code called, rethrown once it returns
+    std::exception_ptr jit_error;
+#endif
 public:
-    VirtualMachine() : heap{1000} {
-        internSymbols();
+    // counted over every invoke and invoketail, the hit rate is
+    // hits / (hits + misses)
+    struct InlineCacheStatistics {
+        std::uint64_t hits;        // calls made straight from the cache
+        std::uint64_t misses;      // calls that had to check their callee
+        std::uint64_t megamorphic; // misses at sites whose cache was full
+    };
+    struct QuickeningStatistics {
+        std::uint64_t quickened;     // instructions rewritten into a variant
+        std::uint64_t despecialized; // variants taken back after a failed guard
+    };
+private:
+    InlineCacheStatistics cache_statistics{0, 0, 0};
+    QuickeningStatistics quickening_statistics{0, 0};
+public:
+    static constexpr std::size_t DEFAULT_HEAP_SIZE = 1024 * 1024;
+    static constexpr std::size_t INITIAL_TEMPS_CAPACITY = 1024;
+    // callees remembered per call site, a site sees one in the common
+    // monomorphic case and a few when it is polymorphic
+    static constexpr std::size_t INLINE_CACHE_ENTRIES = 4;
+    // slot after the entries, true once the site was de-specialized
+    static constexpr std::size_t INLINE_CACHE_DESPECIALIZED = 2 * INLINE_CACHE_ENTRIES;
+    // calls after which the code of a lambda is compiled to machine code
+    static constexpr std::uint64_t JIT_THRESHOLD = 100;
+
+    VirtualMachine(std::size_t heap_size = DEFAULT_HEAP_SIZE) : heap{heap_size}, frames{&heap} {
+        heap.SetSymbolTable(&symbol_table);
+#if FLANG_JIT
+        heap.SetGcObserver(&sweeper);
+#endif
+        global_env = heap.NewEnvironment(heap.GetHandle(Nil()), heap.NewMap(), heap.GetHandle(Nil()));
+        result = heap.GetHandle(Nil());
+        underflow = heap.GetHandle(Nil());
+        heap.AddRootRange(&locals);
+        heap.AddRootRange(&temps);
+        temps.reserve(INITIAL_TEMPS_CAPACITY);
+        registerNatives();
     }
 
-    ~VirtualMachine() = default;
+    ~VirtualMachine() {
+        heap.RemoveRootRange(&temps);
+        heap.RemoveRootRange(&locals);
+    }
 
     NOT_COPYABLE(VirtualMachine);
 
     NOT_MOVEABLE(VirtualMachine);
 
-    void Execute(Handle frame) {
-        while (keepGoing(frame)) {
-            Handle bc = nextBytecode(frame);
-            frame = dispatch(frame, bc);
+    Heap& GetHeap() {
+        return heap;
+    }
+
+    SymbolTable& GetSymbolTable() {
+        return symbol_table;
+    }
+
+    InlineCacheStatistics GetInlineCacheStatistics() const {
+        return cache_statistics;
+    }
+
+    QuickeningStatistics GetQuickeningStatistics() const {
+        return quickening_statistics;
+    }
+
+    // lowers top level bytecode in list form and evaluates it in the
+    // global environment
+    Handle Run(Handle bytecode) {
+        Handle code = Assembler::Assemble(&heap, &symbol_table, bytecode);
+        Handle frame = heap.NewFrame(
+            code,
+            heap.GetHandle(Nil()),
+            heap.NewVector(0),
+            global_env,
+            heap.GetHandle(Nil())
+        );
+        return Execute(frame);
+    }
+
+    // resumes a heap frame and runs until the outermost frame returns or
+    // runs out of bytecode, and yields the value it returned or left on
+    // top of its temps
+    Handle Execute(Handle frame) {
+        result = heap.GetHandle(Nil());
+        discardFrames();
+        resume(frame);
+        Registers r;
+        enter(r);
+        if (!runNative(r)) {
+            return result;
+        }
+        Code::Instruction ins;
+
+        // every handler returns whether to keep running. with computed goto
+        // each handler jumps straight to the next one instead of going back
+        // through a shared switch
+#if FLANG_THREADED_DISPATCH
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wpedantic"
+        static void* const targets[WellKnownSymbols::OPCODE_COUNT] = {
+            #define TARGET(opcode, operands) &&op_##opcode,
+            PER_OPCODE(TARGET)
+            #undef TARGET
+        };
+        #define DISPATCH() goto *targets[fetch(r, ins)]
+        #define HANDLER(opcode, operands) \
+            op_##opcode: if (!on_##opcode(r, ins) || !afterTransfer<WellKnownSymbols::opcode_##opcode>(r)) { goto done; } DISPATCH();
+
+        DISPATCH();
+        PER_OPCODE(HANDLER)
+        #pragma GCC diagnostic pop
+#else
+        #define HANDLER(opcode, operands) \
+            case WellKnownSymbols::opcode_##opcode: \
+                if (!on_##opcode(r, ins) || !afterTransfer<WellKnownSymbols::opcode_##opcode>(r)) { goto done; } \
+                continue;
+
+        for (;;) {
+            switch (fetch(r, ins)) {
+                PER_OPCODE(HANDLER)
+                default: throwUnknownOpcode(ins.opcode);
+            }
         }
+#endif
+        #undef HANDLER
+        #undef DISPATCH
+
+    done:
+        return result;
+    }
+
+    void DefineNative(std::string_view name, std::int64_t arity, NativeFunctionPointer fn) {
+        std::int64_t index = natives.size();
+        natives.push_back(fn);
+        Handle native = heap.NewNativeFunction(
+            heap.GetHandle(Integer(index)),
+            heap.GetHandle(Integer(arity))
+        );
+        Envrionment::Define(&heap, global_env, symbol_table.Intern(name), native);
+        controls.push_back(nullptr);
+        quickenings.push_back(WellKnownSymbols::opcode_invoke);
     }
 
 private:
-    Handle dispatch(Handle frame, Handle bc) {
+    // state of the frame on top of the call stack kept out of it while it
+    // runs. the program counter is only written back when another frame
+    // takes over
+    struct Registers {
+        Primitive* frame = nullptr;
+        std::size_t base = 0;
+        std::size_t pc = 0;
+        // machine code of the frame, and how many times a frame was
+        // entered, which tells machine code that it lost control
+        JitCode* native = nullptr;
+        std::uint64_t entries = 0;
+    };
+
+    void enter(Registers& r) {
+        r.frame = frames.Top();
+        r.base = r.frame[CallStack::TEMPS].AsInteger()->Value();
+        r.pc = r.frame[CallStack::PROGRAM_COUNTER].AsInteger()->Value();
+#if FLANG_JIT
+        r.native = code(r)->Native();
+        r.entries += 1;
+#endif
+    }
+
+    // once an instruction may have handed control to another frame, runs
+    // the machine code of the frame on top if it has any. yields false if
+    // the execution is over
+    template <std::uint8_t opcode>
+    bool afterTransfer(Registers& r) {
+        if constexpr (WellKnownSymbols::TransfersControl(opcode)) {
+            return runNative(r);
+        }
+        return true;
+    }
 
-        Symbol op = *bc.AsPair()->First().AsSymbol();
+    // runs machine code for as long as the frames on top have some
+    bool runNative(Registers& r) {
+#if FLANG_JIT
+        while (r.native != nullptr) {
+            bool running = r.native->Run(this, &r);
+            retired.clear();
+            if (!running) {
+                if (jit_error) {
+                    std::exception_ptr error = jit_error;
+                    jit_error = nullptr;
+                    std::rethrow_exception(error);
+                }
+                return false;
+            }
+        }
+#endif
+        return true;
+    }
 
-        #define DISPATCHER(opcode) \
-            if (shallowEquals(op, symbol_##opcode)) { \
-                return on_##opcode(frame, bc); \
+#if FLANG_JIT
+    // runs a handler for machine code, which cannot unwind
+    template <bool (VirtualMachine::*handler)(Registers&, const Code::Instruction&)>
+    int step(Registers& r, const Code::Instruction& ins) {
+        std::uint64_t entries = r.entries;
+        try {
+            if (!(this->*handler)(r, ins)) {
+                return JitCode::STOP;
             }
-        PER_OPCODE(DISPATCHER)
-        #undef DISPATCHER
+        } catch (...) {
+            jit_error = std::current_exception();
+            return JitCode::STOP;
+        }
+        return r.entries == entries ? JitCode::CONTINUE : JitCode::LEAVE;
+    }
 
+    #define DEFINE_JIT_HANDLER(opcode, operands) \
+        static int jit_##opcode(void* vm, void* r, const Code::Instruction* ins) { \
+            return static_cast<VirtualMachine*>(vm)->step<&VirtualMachine::on_##opcode>(*static_cast<Registers*>(r), *ins); \
+        }
+    PER_OPCODE(DEFINE_JIT_HANDLER)
+    #undef DEFINE_JIT_HANDLER
+
+    void compile(Code* body) {
+        static const std::array<JitCode::Handler, WellKnownSymbols::OPCODE_COUNT> handlers = {
+            #define JIT_HANDLER(opcode, operands) &VirtualMachine::jit_##opcode,
+            PER_OPCODE(JIT_HANDLER)
+            #undef JIT_HANDLER
+        };
+        compiled.push_back(Compiled{body, std::make_unique<JitCode>(body, handlers.data(), offsetof(Registers, pc), offsetof(Registers, native))});
+        body->SetNative(compiled.back().native.get());
+    }
+
+    void sweepCompiled() {
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < compiled.size(); i++) {
+            Object* survivor = Heap::Survivor(compiled[i].owner);
+            if (survivor == nullptr) {
+                DEBUGLN("Retiring " << compiled[i].native->Size() << " bytes of machine code");
+                retired.push_back(std::move(compiled[i].native));
+                continue;
+            }
+            compiled[i].owner = survivor->AsCode();
+            if (kept != i) {
+                compiled[kept] = std::move(compiled[i]);
+            }
+            kept += 1;
+        }
+        compiled.resize(kept);
+    }
+#endif
+
+    void leave(Registers& r) {
+        r.frame[CallStack::PROGRAM_COUNTER] = Integer(r.pc);
+    }
+
+    void pushFrame(Primitive code, Primitive env, Primitive closure, std::size_t base) {
+        Primitive* frame = frames.Push();
+        frame[CallStack::CODE] = code;
+        frame[CallStack::ENV] = env;
+        frame[CallStack::CLOSURE] = closure;
+        frame[CallStack::TEMPS] = Integer(base);
+        frame[CallStack::PROGRAM_COUNTER] = Integer(0);
+    }
+
+    // only valid until the next allocation
+    static Code* code(Registers& r) {
+        return r.frame[CallStack::CODE].AsReference()->Value()->AsCode();
+    }
+
+    // decodes the instruction at the program counter and moves past it
+    std::uint8_t fetch(Registers& r, Code::Instruction& ins) {
+        ins = code(r)->Decode(r.pc);
+        r.pc += Code::InstructionSize(ins.opcode);
+        return ins.opcode;
+    }
+
+    [[noreturn]] static void throwUnknownOpcode(std::uint8_t opcode) {
         std::stringstream stream;
-        stream << "Unknown bytecode: " << symbol_table.ToString(op);
+        stream << "Unknown opcode: " << static_cast<int>(opcode);
         throw std::runtime_error{stream.str()};
     }
 
-    Handle on_load(Handle frame, Handle bc) {
-        advanceProgramCounter(frame);
-        Handle lookup_result = lookup(frame, *getFirstArg(bc).AsSymbol());
-        pushTemp(frame, lookup_result);
-        return frame;
+    bool on_load(Registers& r, const Code::Instruction& ins) {
+        Symbol symbol = *constants(r)->GetItem(Integer(ins.operands[0])).AsSymbol();
+        Primitive* location = Envrionment::Lookup(currentEnv(r.frame), symbol);
+        if (location == nullptr) {
+            throwUnbound(symbol);
+        }
+        pushTemp(*location);
+        return true;
     }
 
-    Handle on_define(Handle frame, Handle bc) {
-        advanceProgramCounter(frame);
-        Handle to_define = popTemp(frame);
-        define(frame, *getFirstArg(bc).AsSymbol(), to_define);
-        pushTemp(frame, heap.GetHandle(Nil()));
-        return frame;
+    bool on_loadlocal(Registers& r, const Code::Instruction& ins) {
+        std::int64_t depth = integerOperand(ins, 0);
+        Integer index = Integer(integerOperand(ins, 1));
+        pushTemp(*localSlot(r.frame, depth, index));
+        return true;
     }
 
-    Handle on_set(Handle frame, Handle bc) {
-        advanceProgramCounter(frame);
-        throw std::runtime_error{"TODO"};
-        return frame;
+    bool on_storelocal(Registers& r, const Code::Instruction& ins) {
+        std::int64_t depth = integerOperand(ins, 0);
+        Integer index = Integer(integerOperand(ins, 1));
+        // finding the slot may promote the locals, which allocates, so the
+        // value stays on the stack until then
+        Primitive* slot = localSlot(r.frame, depth, index);
+        *slot = popTemp(r);
+        pushTemp(Nil());
+        return true;
     }
 
-    Handle on_invoke(Handle frame, Handle bc) {
-        throw std::runtime_error{"TODO"};
-        return frame;
+    bool on_loadfree(Registers& r, const Code::Instruction& ins) {
+        Integer index = Integer(integerOperand(ins, 0));
+        Lambda* closure = r.frame[CallStack::CLOSURE].AsReference()->Value()->AsLambda();
+        pushTemp(closure->Free().AsReference()->Value()->AsVector()->GetItem(index));
+        return true;
     }
 
-    Handle on_invoketail(Handle frame, Handle bc) {
-        throw std::runtime_error{"TODO"};
-        return frame;
+    // replaces the value in a local slot with a box holding it
+    bool on_box(Registers& r, const Code::Instruction& ins) {
+        Integer index = Integer(integerOperand(ins, 0));
+        Handle value = heap.GetHandle(*localSlot(r.frame, 0, index));
+        Handle box = heap.NewBox(value);
+        *localSlot(r.frame, 0, index) = box.Data();
+        return true;
     }
 
-    Handle on_lambda(Handle frame, Handle bc) {
-        throw std::runtime_error{"TODO"};
-        return frame;
+    bool on_unbox(Registers& r, const Code::Instruction& ins) {
+        Primitive& top = topTemp(r);
+        top = top.AsReference()->Value()->AsBox()->Value();
+        return true;
     }
 
-    Handle on_literal(Handle frame, Handle bc) {
-        advanceProgramCounter(frame);
-        pushTemp(frame, getFirstArg(bc));
-        return frame;
+    bool on_setbox(Registers& r, const Code::Instruction& ins) {
+        Primitive value = popTemp(r);
+        Primitive box = popTemp(r);
+        box.AsReference()->Value()->AsBox()->Value() = value;
+        pushTemp(Nil());
+        return true;
     }
 
-    Handle on_pop(Handle frame, Handle bc) {
-        advanceProgramCounter(frame);
-        popTemp(frame);
-        return frame;
+    bool on_loadglobal(Registers& r, const Code::Instruction& ins) {
+        Handle cell = globalCell(r, ins);
+        if (!cell.AsCell()->IsBound()) {
+            throwUnbound(*cell.AsCell()->Name().AsSymbol());
+        }
+        quicken(r, WellKnownSymbols::opcode_loadglobalcell);
+        pushTemp(cell.AsCell()->Value());
+        return true;
     }
 
-    Handle on_jumpiffalse(Handle frame, Handle bc) {
-        throw std::runtime_error{"TODO"};
-        return frame;
+    // loadglobal once its constant is the bound cell, guarded by it still
+    // being bound
+    bool on_loadglobalcell(Registers& r, const Code::Instruction& ins) {
+        Cell* cell = constants(r)->GetItem(Integer(ins.operands[0])).AsReference()->Value()->AsCell();
+        if (!cell->IsBound()) {
+            despecialize(r, WellKnownSymbols::opcode_loadglobal);
+            return on_loadglobal(r, ins);
+        }
+        pushTemp(cell->Value());
+        return true;
     }
 
-    Handle on_jump(Handle frame, Handle bc) {
-        throw std::runtime_error{"TODO"};
-        return frame;
+    bool on_setglobal(Registers& r, const Code::Instruction& ins) {
+        Handle cell = globalCell(r, ins);
+        if (!cell.AsCell()->IsBound()) {
+            throwUnbound(*cell.AsCell()->Name().AsSymbol());
+        }
+        cell.AsCell()->Value() = popTemp(r);
+        pushTemp(Nil());
+        return true;
     }
 
-    Handle on_return(Handle frame, Handle bc) {
-        throw std::runtime_error{"TODO"};
-        return frame;
+    bool on_defineglobal(Registers& r, const Code::Instruction& ins) {
+        Handle cell = globalCell(r, ins);
+        cell.AsCell()->Value() = popTemp(r);
+        cell.AsCell()->Bound() = Boolean(true);
+        pushTemp(Nil());
+        return true;
     }
 
-    void define(Handle frame, Symbol symbol, Handle value) {
-        throw std::runtime_error{"TODO"};
+    bool on_define(Registers& r, const Code::Instruction& ins) {
+        Handle to_define = heap.GetHandle(popTemp(r));
+        define(r.frame, *constant(r, ins, 0).AsSymbol(), to_define);
+        pushTemp(Nil());
+        return true;
     }
 
-    Handle lookup(Handle frame, Symbol symbol) {
-        throw std::runtime_error{"TODO"};
-        return heap.GetHandle(Nil());
+    bool on_set(Registers& r, const Code::Instruction& ins) {
+        Symbol symbol = *constants(r)->GetItem(Integer(ins.operands[0])).AsSymbol();
+        Primitive* location = Envrionment::Lookup(currentEnv(r.frame), symbol);
+        if (location == nullptr) {
+            throwUnbound(symbol);
+        }
+        *location = popTemp(r);
+        pushTemp(Nil());
+        return true;
     }
 
-    void advanceProgramCounter(Handle frame) {
-        frame.AsFrame()->AdvanceProgramCounter();
+    // the receiver and the arguments stay on the stack until the call has
+    // taken them, so they need no handles
+    bool on_invoke(Registers& r, const Code::Instruction& ins) {
+        std::size_t count = integerOperand(ins, 0);
+        invokeCached(r, ins, temps.size() - count, count - 1, false);
+        return true;
     }
 
-    void pushTemp(Handle frame, Handle value) {
-        Handle temps = heap.GetHandle(frame.AsFrame()->Temps());
-        Stack::Push(&heap, temps, value);
+    // the running call has nothing left to do, so a lambda takes over its
+    // frame, its place on the operand stack and its native locals. anything
+    // else is invoked as usual and its value left for the return after it
+    bool on_invoketail(Registers& r, const Code::Instruction& ins) {
+        std::size_t count = integerOperand(ins, 0);
+        std::size_t first = temps.size() - count;
+        if (!isLambda(temps[first])) {
+            invokeCached(r, ins, first, count - 1, false);
+            return true;
+        }
+        releaseLocals(r.frame);
+        std::copy(temps.begin() + first, temps.end(), temps.begin() + r.base);
+        temps.resize(r.base + count);
+        invokeCached(r, ins, r.base, count - 1, true);
+        return true;
     }
 
-    Handle popTemp(Handle frame) {
-        Handle temps = heap.GetHandle(frame.AsFrame()->Temps());
-        return Stack::Pop(&heap, temps);
+    // (lambda params body nlocals nfree heaplocals) closes over the top
+    // nfree temps
+    bool on_lambda(Registers& r, const Code::Instruction& ins) {
+        std::size_t count = integerOperand(ins, 3);
+        Handle free = heap.NewVector(count);
+        std::size_t first = temps.size() - count;
+        for (std::size_t i = 0; i < count; i++) {
+            free.AsVector()->SetItem(Integer(i), temps[first + i]);
+        }
+        temps.resize(first);
+        Handle created = heap.NewLambda(
+            constant(r, ins, 0),
+            free,
+            constant(r, ins, 1),
+            heap.GetHandle(Integer(integerOperand(ins, 2))),
+            heap.GetHandle(Boolean(integerOperand(ins, 4) != 0))
+        );
+        pushTemp(created.Data());
+        return true;
     }
 
-    Handle getFirstArg(Handle bc) {
-        Pair* p = bc.AsPair();
-        p = p->Second().AsReference()->Value()->AsPair();
-        return heap.GetHandle(p->First());
+    bool on_literal(Registers& r, const Code::Instruction& ins) {
+        pushTemp(constants(r)->GetItem(Integer(ins.operands[0])));
+        return true;
     }
 
-    bool keepGoing(Handle frame) const {
-        Frame* f = frame.AsFrame();
-        Integer pc = *f->ProgramCounter().AsInteger();
-        Integer bc_length = f->BytecodeLength();
-        return pc.Value() < bc_length.Value();
+    // (makerecord n) makes a record of the descriptor below the top n temps
+    bool on_makerecord(Registers& r, const Code::Instruction& ins) {
+        std::size_t count = integerOperand(ins, 0);
+        std::size_t first = temps.size() - count;
+        Handle descriptor = heap.GetHandle(temps.at(first - 1));
+        std::size_t expected = descriptor.AsRecordType()->FieldCount().Value();
+        if (expected != count) {
+            std::stringstream stream;
+            stream << "Record has " << expected << " fields but was made with " << count;
+            throw std::runtime_error{stream.str()};
+        }
+        Handle record = heap.NewRecord(descriptor);
+        for (std::size_t i = 0; i < count; i++) {
+            record.AsRecord()->SetField(Integer(i), temps[first + i]);
+        }
+        temps.resize(first - 1);
+        pushTemp(record.Data());
+        return true;
     }
 
-    Handle nextBytecode(Handle frame) {
-        Frame* f = frame.AsFrame();
-        return heap.GetHandle(f->NextBytecode());
+    // (recordref index) with the record and then its descriptor on top
+    bool on_recordref(Registers& r, const Code::Instruction& ins) {
+        Primitive descriptor = popTemp(r);
+        Primitive& top = topTemp(r);
+        top = checkedRecord(top, descriptor)->GetField(Integer(integerOperand(ins, 0)));
+        return true;
     }
 
-    void internSymbols() {
-        #define INTERN(s) symbol_##s = symbol_table.Intern(#s);
-        PER_OPCODE(INTERN)
-        #undef INTERN
+    // (recordset index) with the record, its descriptor and the value on top
+    bool on_recordset(Registers& r, const Code::Instruction& ins) {
+        Primitive value = popTemp(r);
+        Primitive descriptor = popTemp(r);
+        Primitive record = popTemp(r);
+        checkedRecord(record, descriptor)->SetField(Integer(integerOperand(ins, 0)), value);
+        pushTemp(Nil());
+        return true;
     }
 
-    bool shallowEquals(Primitive p1, Primitive p2) {
+    bool on_pop(Registers& r, const Code::Instruction& ins) {
+        popTemp(r);
+        return true;
+    }
+
+    // invoke of an integer native with two integers, guarded by the
+    // receiver still being the one the site cached and by the types of the
+    // arguments. a site whose guard failed is never quickened again
+    #define DEFINE_QUICKENED_INVOKE(name, text, op, type) \
+        bool on_invoke##name(Registers& r, const Code::Instruction& ins) { \
+            std::size_t first = temps.size() - integerOperand(ins, 0); \
+            Primitive left = temps[first + 1]; \
+            Primitive right = temps[first + 2]; \
+            if (!isCachedCallee(r, ins, first) \
+                || left.GetType() != Primitive::Type::Integer \
+                || right.GetType() != Primitive::Type::Integer) { \
+                constants(r)->GetItem(Integer(ins.operands[1])).AsReference()->Value()->AsVector() \
+                    ->SetItem(Integer(INLINE_CACHE_DESPECIALIZED), Boolean(true)); \
+                despecialize(r, WellKnownSymbols::opcode_invoke); \
+                return on_invoke(r, ins); \
+            } \
+            temps.resize(first); \
+            pushTemp(type(left.AsInteger()->Value() op right.AsInteger()->Value())); \
+            return true; \
+        }
+    #define DEFINE_QUICKENED_ARITHMETIC(name, text, op) DEFINE_QUICKENED_INVOKE(name, text, op, Integer)
+    #define DEFINE_QUICKENED_COMPARISON(name, text, op) DEFINE_QUICKENED_INVOKE(name, text, op, Boolean)
+    PER_INTEGER_ARITHMETIC_NATIVE(DEFINE_QUICKENED_ARITHMETIC)
+    PER_INTEGER_COMPARISON_NATIVE(DEFINE_QUICKENED_COMPARISON)
+    #undef DEFINE_QUICKENED_COMPARISON
+    #undef DEFINE_QUICKENED_ARITHMETIC
+    #undef DEFINE_QUICKENED_INVOKE
+
+    bool on_jumpiffalse(Registers& r, const Code::Instruction& ins) {
+        if (isFalse(popTemp(r))) {
+            r.pc += integerOperand(ins, 0);
+        }
+        return true;
+    }
+
+    bool on_jump(Registers& r, const Code::Instruction& ins) {
+        r.pc += integerOperand(ins, 0);
+        return true;
+    }
+
+    bool on_return(Registers& r, const Code::Instruction& ins) {
+        Primitive value = popTemp(r);
+        releaseLocals(r.frame);
+        temps.resize(r.base);
+        frames.Pop();
+        if (frames.Empty()) {
+            if (isNil(underflow)) {
+                result = heap.GetHandle(value);
+                return false;
+            }
+            Handle kept = heap.GetHandle(value);
+            resume(underflow);
+            value = kept.Data();
+        }
+        enter(r);
+        pushTemp(value);
+        return true;
+    }
+
+    // the end of every Code, running into it ends the whole execution
+    bool on_halt(Registers& r, const Code::Instruction& ins) {
+        if (temps.size() > r.base) {
+            result = heap.GetHandle(popTemp(r));
+        }
         return false;
     }
+
+    // calls the receiver at temps[first] with the argc values above it,
+    // which are all popped once the call has them
+    void invoke(Registers& r, std::size_t first, std::size_t argc) {
+        Primitive receiver = temps.at(first);
+        if (receiver.GetType() != Primitive::Type::Reference) {
+            throw std::runtime_error{"Cannot invoke a non object"};
+        }
+
+        Object* obj = receiver.AsReference()->Value();
+
+        if (obj->IsLambda()) {
+            callLambda(r, first, argc, false);
+            return;
+        }
+
+        if (obj->IsNativeFunction()) {
+            NativeFunction* fn = obj->AsNativeFunction();
+            checkArity(fn->Arity().AsInteger()->Value(), argc);
+            std::int64_t index = fn->Index().AsInteger()->Value();
+            if (controls.at(index) != nullptr) {
+                (this->*controls[index])(r, first, argc);
+                return;
+            }
+            callNative(first, argc, index);
+            return;
+        }
+
+        if (obj->IsEscapeContinuation()) {
+            checkArity(1, argc);
+            unwindTo(r, first);
+            return;
+        }
+
+        if (obj->IsContinuation()) {
+            checkArity(1, argc);
+            Handle value = heap.GetHandle(temps[first + 1]);
+            Handle frame = heap.GetHandle(obj->AsContinuation()->Frame());
+            Handle prompt = heap.GetHandle(obj->AsContinuation()->Prompt());
+            if (isNil(prompt)) {
+                discardFrames();
+                resume(frame);
+            } else {
+                temps.resize(first);
+                leave(r);
+                compose(frame, prompt);
+            }
+            enter(r);
+            pushTemp(value.Data());
+            return;
+        }
+
+        std::stringstream stream;
+        stream << "Cannot invoke object of type " << Object::TypeToString(objectType(obj));
+        throw std::runtime_error{stream.str()};
+    }
+
+    // invokes the receiver at temps[first] through the inline cache of the
+    // call site. a receiver found in the cache was already checked to be a
+    // lambda or an ordinary native taking argc arguments, so it is called
+    // without looking at its type or arity again
+    void invokeCached(Registers& r, const Code::Instruction& ins, std::size_t first, std::size_t argc, bool tail) {
+        Primitive receiver = temps[first];
+        Primitive cache = constants(r)->GetItem(Integer(ins.operands[1]));
+        if (receiver.GetType() == Primitive::Type::Reference && cache.GetType() == Primitive::Type::Reference) {
+            Vector* entries = cache.AsReference()->Value()->AsVector();
+            Primitive key = cacheKey(receiver);
+            for (std::size_t i = 0; i < INLINE_CACHE_ENTRIES; i++) {
+                Primitive callee = entries->GetItem(Integer(2 * i));
+                if (callee.Bits() == key.Bits()) {
+                    cache_statistics.hits += 1;
+                    Primitive target = entries->GetItem(Integer(2 * i + 1));
+                    if (target.GetType() == Primitive::Type::Integer) {
+                        std::int64_t index = target.AsInteger()->Value();
+                        if (i == 0 && ins.opcode == WellKnownSymbols::opcode_invoke) {
+                            quickenInvoke(r, entries, first, argc, index);
+                        }
+                        callNative(first, argc, index);
+                    } else {
+                        enterLambda(r, first, argc, tail);
+                    }
+                    return;
+                }
+                if (callee.GetType() == Primitive::Type::Nil) {
+                    break;
+                }
+            }
+        }
+
+        cache_statistics.misses += 1;
+        if (!isCacheable(receiver, argc)) {
+            if (tail) {
+                callLambda(r, first, argc, true);
+            } else {
+                invoke(r, first, argc);
+            }
+            return;
+        }
+        Primitive target = addToCache(r, ins, first);
+        if (target.GetType() == Primitive::Type::Integer) {
+            callNative(first, argc, target.AsInteger()->Value());
+        } else {
+            enterLambda(r, first, argc, tail);
+        }
+    }
+
+    // a site that only ever called one native with a quickened variant,
+    // and now calls it with integers, is rewritten to that variant
+    void quickenInvoke(Registers& r, Vector* entries, std::size_t first, std::size_t argc, std::int64_t index) {
+        std::uint8_t quickened = quickenings[index];
+        if (quickened == WellKnownSymbols::opcode_invoke || argc != 2) {
+            return;
+        }
+        if (entries->GetItem(Integer(INLINE_CACHE_DESPECIALIZED)).GetType() != Primitive::Type::Nil) {
+            return;
+        }
+        if (entries->GetItem(Integer(2)).GetType() != Primitive::Type::Nil) {
+            return;
+        }
+        if (temps[first + 1].GetType() != Primitive::Type::Integer || temps[first + 2].GetType() != Primitive::Type::Integer) {
+            return;
+        }
+        quicken(r, quickened);
+    }
+
+    // whether the receiver at temps[first] is the first callee in the
+    // cache of the site
+    bool isCachedCallee(Registers& r, const Code::Instruction& ins, std::size_t first) {
+        Primitive cache = constants(r)->GetItem(Integer(ins.operands[1]));
+        return cache.GetType() == Primitive::Type::Reference
+            && cache.AsReference()->Value()->AsVector()->GetItem(Integer(0)).Bits() == temps[first].Bits();
+    }
+
+    void quicken(Registers& r, std::uint8_t opcode) {
+        rewrite(r, opcode);
+        quickening_statistics.quickened += 1;
+    }
+
+    void despecialize(Registers& r, std::uint8_t opcode) {
+        rewrite(r, opcode);
+        quickening_statistics.despecialized += 1;
+    }
+
+    // rewrites the running instruction, the next time it runs it is the
+    // given opcode. quickened opcodes have the format of the instruction
+    // they replace, so the size and the program counter stay the same
+    void rewrite(Registers& r, std::uint8_t opcode) {
+        std::size_t at = r.pc - Code::InstructionSize(opcode);
+        Code* body = code(r);
+        body->SetOpcodeAt(at, opcode);
+#if FLANG_JIT
+        if (body->Native() != nullptr) {
+            body->Native()->Rewrite(at, opcode);
+        }
+#endif
+    }
+
+    // lambdas and the natives that return a value can be called from the
+    // cache, controls and continuations always go through invoke
+    bool isCacheable(Primitive receiver, std::size_t argc) {
+        if (isLambda(receiver)) {
+            return lambdaArity(receiver) == static_cast<std::int64_t>(argc);
+        }
+        if (receiver.GetType() != Primitive::Type::Reference || !receiver.AsReference()->Value()->IsNativeFunction()) {
+            return false;
+        }
+        NativeFunction* fn = receiver.AsReference()->Value()->AsNativeFunction();
+        return fn->Arity().AsInteger()->Value() == static_cast<std::int64_t>(argc)
+            && controls.at(fn->Index().AsInteger()->Value()) == nullptr;
+    }
+
+    // lambdas are cached by their Code, which every closure made by the
+    // same lambda instruction shares along with its parameters, so a site
+    // that is handed a fresh closure on every call stays monomorphic and
+    // the cache keeps no closure, or anything it captured, alive. natives
+    // are cached by themselves
+    static Primitive cacheKey(Primitive receiver) {
+        Object* obj = receiver.AsReference()->Value();
+        return obj->IsLambda() ? obj->AsLambda()->Bytecode() : receiver;
+    }
+
+    // records the receiver at temps[first] in the first free entry of the
+    // cache of the call site, allocating the cache on the first miss, and
+    // yields what calling it needs: the Code of a lambda or the index of a
+    // native. a full cache is left alone, the site is megamorphic
+    Primitive addToCache(Registers& r, const Code::Instruction& ins, std::size_t first) {
+        Handle cache = constant(r, ins, 1);
+        if (isNil(cache)) {
+            cache = heap.NewVector(2 * INLINE_CACHE_ENTRIES + 1);
+            constants(r)->SetItem(Integer(ins.operands[1]), cache.Data());
+        }
+        Object* obj = temps[first].AsReference()->Value();
+        Primitive target = obj->IsLambda()
+            ? obj->AsLambda()->Bytecode()
+            : obj->AsNativeFunction()->Index();
+        Vector* entries = cache.AsVector();
+        for (std::size_t i = 0; i < INLINE_CACHE_ENTRIES; i++) {
+            if (entries->GetItem(Integer(2 * i)).GetType() == Primitive::Type::Nil) {
+                entries->SetItem(Integer(2 * i), cacheKey(temps[first]));
+                entries->SetItem(Integer(2 * i + 1), target);
+                return target;
+            }
+        }
+        cache_statistics.megamorphic += 1;
+        return target;
+    }
+
+    // calls the native at index with the arguments above temps[first] and
+    // leaves its value in place of the call
+    void callNative(std::size_t first, std::size_t argc, std::int64_t index) {
+        NativeFunctionPointer ptr = natives[index];
+        std::vector<Handle> args(argc);
+        for (std::size_t i = 0; i < argc; i++) {
+            args[i] = heap.GetHandle(temps[first + 1 + i]);
+        }
+        temps.resize(first);
+        Handle value = ptr(this, args);
+        pushTemp(value.Data());
+    }
+
+    static std::int64_t lambdaArity(Primitive lambda) {
+        Lambda* fn = lambda.AsReference()->Value()->AsLambda();
+        return fn->Parameters().AsReference()->Value()->AsVector()->Length().Value();
+    }
+
+    // moves the arguments above the lambda at temps[first] into its locals
+    // and runs it in a new frame, or for a tail call in place of the
+    // running frame, whose temps must already be gone
+    void callLambda(Registers& r, std::size_t first, std::size_t argc, bool tail) {
+        checkArity(lambdaArity(temps[first]), argc);
+        enterLambda(r, first, argc, tail);
+    }
+
+    // callLambda once the arity is known to match
+    void enterLambda(Registers& r, std::size_t first, std::size_t argc, bool tail) {
+        Lambda* fn = temps[first].AsReference()->Value()->AsLambda();
+#if FLANG_JIT
+        Code* body = fn->Bytecode().AsReference()->Value()->AsCode();
+        if (body->CountCall() == JIT_THRESHOLD) {
+            compile(body);
+        }
+#endif
+        std::int64_t count = fn->Locals().AsInteger()->Value();
+        Primitive env;
+        if (fn->HasHeapLocals()) {
+            Handle slots = heap.NewVector(count);
+            for (std::size_t i = 0; i < argc; i++) {
+                slots.AsVector()->SetItem(Integer(i), temps[first + 1 + i]);
+            }
+            env = newLocalEnvironment(slots).Data();
+        } else {
+            std::size_t base = locals.size();
+            locals.resize(base + count, Nil());
+            for (std::size_t i = 0; i < argc; i++) {
+                locals[base + i] = temps[first + 1 + i];
+            }
+            env = Integer(base);
+        }
+        Primitive callee = temps[first];
+        Primitive mark = Nil();
+        temps.resize(first);
+        if (tail) {
+            // still inside the call/ec the replaced frame was called for
+            mark = r.frame[CallStack::MARK];
+            frames.Pop();
+        } else {
+            leave(r);
+        }
+        pushFrame(callee.AsReference()->Value()->AsLambda()->Bytecode(), env, callee, first);
+        frames.Top()[CallStack::MARK] = mark;
+        enter(r);
+    }
+
+    // (call-with-escape-continuation f) calls f with a continuation that
+    // can only escape from the call. nothing is copied, f's frame is only
+    // marked with it
+    void control_call_ec(Registers& r, std::size_t first, std::size_t argc) {
+        Handle escape = heap.NewEscapeContinuation(heap.GetHandle(Integer(frames.Depth())));
+        temps[first] = temps[first + 1];
+        temps[first + 1] = escape.Data();
+        if (!isLambda(temps[first])) {
+            invoke(r, first, 1);
+            return;
+        }
+        callLambda(r, first, 1, false);
+        frames.Top()[CallStack::MARK] = escape.Data();
+    }
+
+    // drops every frame up to and including the one marked with the escape
+    // continuation at temps[first] and returns the value above it from
+    // that frame
+    void unwindTo(Registers& r, std::size_t first) {
+        Primitive escape = temps[first];
+        Primitive value = temps[first + 1];
+        std::size_t depth = escape.AsReference()->Value()->AsEscapeContinuation()->Depth().AsInteger()->Value();
+        std::size_t index = frames.Depth();
+        if (depth < frames.Depth() && frames.At(depth)[CallStack::MARK].Bits() == escape.Bits()) {
+            index = depth;
+        } else {
+            // a continuation resumed since may have put the frame elsewhere
+            for (std::size_t i = frames.Depth(); i > 0; i--) {
+                if (frames.At(i - 1)[CallStack::MARK].Bits() == escape.Bits()) {
+                    index = i - 1;
+                    break;
+                }
+            }
+        }
+
+        if (index < frames.Depth()) {
+            Handle kept = heap.GetHandle(value);
+            dropFrames(index);
+            enter(r);
+            pushTemp(kept.Data());
+            return;
+        }
+
+        // or moved it to the heap
+        for (Handle frame = underflow; !isNil(frame); frame = heap.GetHandle(frame.AsFrame()->Outer())) {
+            if (frame.AsFrame()->Mark().Bits() == escape.Bits()) {
+                Handle kept = heap.GetHandle(value);
+                Handle outer = heap.GetHandle(frame.AsFrame()->Outer());
+                discardFrames();
+                resume(outer);
+                enter(r);
+                pushTemp(kept.Data());
+                return;
+            }
+        }
+
+        throw std::runtime_error{"Escape continuation invoked after its call returned"};
+    }
+
+    // records of a type are only ever made from its one descriptor, so
+    // comparing the descriptor is the whole type check of a field access
+    Record* checkedRecord(Primitive record, Primitive descriptor) {
+        if (isRecordOf(record, descriptor)) {
+            return record.AsReference()->Value()->AsRecord();
+        }
+        std::stringstream stream;
+        RecordType* type = descriptor.AsReference()->Value()->AsRecordType();
+        stream << "Expected a record of type " << symbol_table.ToString(*type->Name().AsSymbol());
+        throw std::runtime_error{stream.str()};
+    }
+
+    static bool isRecordOf(Primitive value, Primitive descriptor) {
+        if (value.GetType() != Primitive::Type::Reference || !value.AsReference()->Value()->IsRecord()) {
+            return false;
+        }
+        return value.AsReference()->Value()->AsRecord()->Descriptor().Bits() == descriptor.Bits();
+    }
+
+    void define(Primitive* frame, Symbol symbol, Handle value) {
+        // promotes native locals, only heap environments can be defined into
+        currentEnv(frame);
+        Handle env = heap.GetHandle(frame[CallStack::ENV]);
+        Envrionment::Define(&heap, env, symbol, value);
+    }
+
+    Handle lookup(Primitive* frame, Symbol symbol) {
+        Primitive* result = Envrionment::Lookup(currentEnv(frame), symbol);
+        if (result == nullptr) {
+            throwUnbound(symbol);
+        }
+        return heap.GetHandle(*result);
+    }
+
+    // the cell operand of a global instruction. instructions are linked the
+    // first time they run by replacing their symbol constant with its cell
+    Handle globalCell(Registers& r, const Code::Instruction& ins) {
+        Handle operand = constant(r, ins, 0);
+        if (operand.Data().GetType() != Primitive::Type::Symbol) {
+            return operand;
+        }
+        Handle cell = Envrionment::Intern(&heap, global_env, *operand.AsSymbol());
+        constants(r)->SetItem(Integer(ins.operands[0]), cell.Data());
+        return cell;
+    }
+
+    // captured variables live in the closure, so the only outer scope a
+    // call can still reach dynamically is the global one
+    Handle newLocalEnvironment(Handle slots) {
+        return heap.NewEnvironment(global_env, heap.GetHandle(Nil()), slots);
+    }
+
+    static bool hasNativeLocals(Primitive* frame) {
+        return frame[CallStack::ENV].GetType() == Primitive::Type::Integer;
+    }
+
+    // only valid until the next allocation or invoke
+    Primitive* localSlot(Primitive* frame, std::int64_t depth, Integer index) {
+        if (depth == 0 && hasNativeLocals(frame)) {
+            return &locals.at(frame[CallStack::ENV].AsInteger()->Value() + index.Value());
+        }
+        Envrionment* env = Envrionment::Resolve(currentEnv(frame), depth);
+        return env->SlotVector()->ItemPtr(index);
+    }
+
+    void releaseLocals(Primitive* frame) {
+        if (hasNativeLocals(frame)) {
+            locals.resize(frame[CallStack::ENV].AsInteger()->Value());
+        }
+    }
+
+    // moves the native locals of the frames on the call stack from the
+    // index'th up into heap environments, for when something needs the
+    // environment itself or the frames are about to outlive their place in
+    // the locals region. locals are pushed in call order, so theirs are
+    // the top of the region
+    void promoteLocals(std::size_t from = 0) {
+        std::size_t lowest = locals.size();
+        for (std::size_t i = from; i < frames.Depth(); i++) {
+            Primitive* frame = frames.At(i);
+            if (!hasNativeLocals(frame)) {
+                continue;
+            }
+            std::size_t base = frame[CallStack::ENV].AsInteger()->Value();
+            std::int64_t count = frame[CallStack::CLOSURE].AsReference()->Value()->AsLambda()->Locals().AsInteger()->Value();
+            Handle slots = heap.NewVector(count);
+            for (std::int64_t i = 0; i < count; i++) {
+                slots.AsVector()->SetItem(Integer(i), locals.at(base + i));
+            }
+            frame[CallStack::ENV] = newLocalEnvironment(slots).Data();
+            lowest = std::min(lowest, base);
+        }
+        DEBUGLN("Promoted native locals above " << lowest << " to the heap");
+        locals.resize(lowest);
+    }
+
+    Envrionment* currentEnv(Primitive* frame) {
+        if (hasNativeLocals(frame)) {
+            promoteLocals();
+        }
+        return frame[CallStack::ENV].AsReference()->Value()->AsEnvrionment();
+    }
+
+    // copies the frames on the call stack from the index'th up into heap
+    // frames on top of outer and returns the topmost. the frames stay on
+    // the call stack
+    Handle heapifyFrames(std::size_t from, Handle outer) {
+        promoteLocals(from);
+        for (std::size_t i = from; i < frames.Depth(); i++) {
+            Primitive* frame = frames.At(i);
+            std::size_t base = frame[CallStack::TEMPS].AsInteger()->Value();
+            std::size_t end = i + 1 < frames.Depth() ? frames.At(i + 1)[CallStack::TEMPS].AsInteger()->Value() : temps.size();
+            Handle saved = heap.NewVector(end - base);
+            for (std::size_t j = base; j < end; j++) {
+                saved.AsVector()->SetItem(Integer(j - base), temps[j]);
+            }
+            outer = heap.NewFrame(
+                heap.GetHandle(frame[CallStack::CODE]),
+                outer,
+                saved,
+                heap.GetHandle(frame[CallStack::ENV]),
+                heap.GetHandle(frame[CallStack::CLOSURE])
+            );
+            outer.AsFrame()->ProgramCounter() = frame[CallStack::PROGRAM_COUNTER];
+            outer.AsFrame()->Mark() = frame[CallStack::MARK];
+        }
+        return outer;
+    }
+
+    // drops every frame on the call stack along with their temps and locals
+    void discardFrames() {
+        frames.Clear();
+        temps.clear();
+        locals.clear();
+        underflow = heap.GetHandle(Nil());
+    }
+
+    // drops the frames on the call stack from the index'th up, leaving the
+    // frame below them, which may first have to be resumed, to run next
+    void dropFrames(std::size_t index) {
+        std::size_t base = frames.At(index)[CallStack::TEMPS].AsInteger()->Value();
+        while (frames.Depth() > index) {
+            releaseLocals(frames.Top());
+            frames.Pop();
+        }
+        temps.resize(base);
+        if (frames.Empty()) {
+            resume(underflow);
+        }
+    }
+
+    // copies a heap frame onto the top of the call stack
+    void pushHeapFrame(Handle frame) {
+        Handle saved = heap.GetHandle(frame.AsFrame()->Temps());
+        std::size_t base = temps.size();
+        for (std::int64_t i = 0; i < saved.AsVector()->Length().Value(); i++) {
+            temps.push_back(saved.AsVector()->GetItem(Integer(i)));
+        }
+        Frame* f = frame.AsFrame();
+        pushFrame(f->Bytecode(), f->Env(), f->Closure(), base);
+        frames.Top()[CallStack::PROGRAM_COUNTER] = f->ProgramCounter();
+        frames.Top()[CallStack::MARK] = f->Mark();
+    }
+
+    // copies a heap frame onto the call stack, leaving the frames it
+    // returns to in the heap until they are returned into
+    void resume(Handle frame) {
+        pushHeapFrame(frame);
+        underflow = heap.GetHandle(frame.AsFrame()->Outer());
+    }
+
+    // pushes the frames of a delimited continuation on top of the call
+    // stack, from the one marked with its prompt up to frame
+    void compose(Handle frame, Handle prompt) {
+        std::vector<Handle> delimited;
+        for (Handle f = frame; ; f = heap.GetHandle(f.AsFrame()->Outer())) {
+            delimited.push_back(f);
+            if (f.AsFrame()->Mark().Bits() == prompt.Data().Bits()) {
+                break;
+            }
+        }
+        for (std::size_t i = delimited.size(); i > 0; i--) {
+            pushHeapFrame(delimited[i - 1]);
+        }
+    }
+
+    static bool isPromptFor(Primitive mark, Primitive tag) {
+        if (mark.GetType() != Primitive::Type::Reference || !mark.AsReference()->Value()->IsPrompt()) {
+            return false;
+        }
+        return mark.AsReference()->Value()->AsPrompt()->Tag().Bits() == tag.Bits();
+    }
+
+    // index of the nearest frame on the call stack marked with a prompt for
+    // tag. a full continuation may have moved that frame to the heap, then
+    // the frames from it up are brought back onto the call stack first
+    std::size_t findPrompt(Primitive tag) {
+        for (std::size_t i = frames.Depth(); i > 0; i--) {
+            if (isPromptFor(frames.At(i - 1)[CallStack::MARK], tag)) {
+                return i - 1;
+            }
+        }
+
+        Handle found = heap.GetHandle(Nil());
+        for (Handle f = underflow; !isNil(f); f = heap.GetHandle(f.AsFrame()->Outer())) {
+            if (isPromptFor(f.AsFrame()->Mark(), tag)) {
+                found = f;
+                break;
+            }
+        }
+        if (isNil(found)) {
+            throw std::runtime_error{"No continuation prompt for the tag"};
+        }
+
+        DEBUGLN("Prompt is in the heap, moving " << frames.Depth() << " frames there to reach it");
+        Handle top = heapifyFrames(0, underflow);
+        discardFrames();
+        compose(top, heap.GetHandle(found.AsFrame()->Mark()));
+        underflow = heap.GetHandle(found.AsFrame()->Outer());
+        return 0;
+    }
+
+    // calls the receiver at temps[first] with the argc values above it in a
+    // frame marked with mark. natives run without a frame of their own, so
+    // they are not marked
+    void callMarked(Registers& r, std::size_t first, std::size_t argc, Primitive mark) {
+        if (!isLambda(temps[first])) {
+            invoke(r, first, argc);
+            return;
+        }
+        callLambda(r, first, argc, false);
+        frames.Top()[CallStack::MARK] = mark;
+    }
+
+    // (call-with-current-continuation f) calls f with the continuation of
+    // the call, which is captured by moving the call stack to the heap
+    void control_call_cc(Registers& r, std::size_t first, std::size_t argc) {
+        Handle fn = heap.GetHandle(temps[first + 1]);
+        temps.resize(first);
+        leave(r);
+        Handle captured = heapifyFrames(0, underflow);
+        discardFrames();
+        resume(captured);
+        Handle continuation = heap.NewContinuation(captured, heap.GetHandle(Nil()));
+        enter(r);
+        pushTemp(fn.Data());
+        pushTemp(continuation.Data());
+        invoke(r, temps.size() - 2, 1);
+    }
+
+    // (call-with-continuation-prompt thunk tag) calls thunk with its frame
+    // marked with a prompt for tag
+    void control_call_with_prompt(Registers& r, std::size_t first, std::size_t argc) {
+        Handle prompt = heap.NewPrompt(heap.GetHandle(temps[first + 2]));
+        temps[first] = temps[first + 1];
+        temps.resize(first + 1);
+        callMarked(r, first, 0, prompt.Data());
+    }
+
+    // (abort-current-continuation tag value) drops the frames up to the
+    // nearest prompt for tag and returns value from the prompt's call
+    void control_abort(Registers& r, std::size_t first, std::size_t argc) {
+        Handle tag = heap.GetHandle(temps[first + 1]);
+        Handle value = heap.GetHandle(temps[first + 2]);
+        temps.resize(first);
+        leave(r);
+        dropFrames(findPrompt(tag.Data()));
+        enter(r);
+        pushTemp(value.Data());
+    }
+
+    // (call-with-delimited-continuation f tag) is shift. it moves the frames
+    // up to the nearest prompt for tag into a continuation, drops them and
+    // calls f with the continuation under the same prompt in their place.
+    // only the delimited frames are copied, however deep the stack below is
+    void control_call_with_delimited(Registers& r, std::size_t first, std::size_t argc) {
+        Handle fn = heap.GetHandle(temps[first + 1]);
+        Handle tag = heap.GetHandle(temps[first + 2]);
+        temps.resize(first);
+        leave(r);
+        std::size_t index = findPrompt(tag.Data());
+        Handle prompt = heap.GetHandle(frames.At(index)[CallStack::MARK]);
+        Handle captured = heapifyFrames(index, heap.GetHandle(Nil()));
+        Handle continuation = heap.NewContinuation(captured, prompt);
+        dropFrames(index);
+        enter(r);
+        pushTemp(fn.Data());
+        pushTemp(continuation.Data());
+        callMarked(r, temps.size() - 2, 1, prompt.Data());
+    }
+
+    void throwUnbound(Symbol symbol) {
+        std::stringstream stream;
+        stream << "Unbound variable: " << symbol_table.ToString(symbol);
+        throw std::runtime_error{stream.str()};
+    }
+
+    static void checkArity(std::int64_t expected, std::size_t actual) {
+        if (expected != static_cast<std::int64_t>(actual)) {
+            std::stringstream stream;
+            stream << "Arity mismatch, expected " << expected << " arguments but got " << actual;
+            throw std::runtime_error{stream.str()};
+        }
+    }
+
+    static Object::Type objectType(Object* obj) {
+        #define CHECK_TYPE(v) if (obj->Is##v()) { return Object::Type::v; }
+        PER_CONCRETE_OBJECT_TYPE(CHECK_TYPE)
+        #undef CHECK_TYPE
+        return Object::Type::GcForward;
+    }
+
+    static bool isNil(Handle value) {
+        return value.Data().GetType() == Primitive::Type::Nil;
+    }
+
+    static bool isLambda(Primitive value) {
+        return value.GetType() == Primitive::Type::Reference && value.AsReference()->Value()->IsLambda();
+    }
+
+    // only #f is false
+    static bool isFalse(Primitive value) {
+        return value.GetType() == Primitive::Type::Boolean && !value.AsBoolean()->Value();
+    }
+
+    void pushTemp(Primitive value) {
+        temps.push_back(value);
+    }
+
+    Primitive popTemp(Registers& r) {
+        if (temps.size() <= r.base) {
+            throw std::runtime_error{"Pop called on empty stack"};
+        }
+        Primitive value = temps.back();
+        temps.pop_back();
+        return value;
+    }
+
+    // only valid until the next push
+    Primitive& topTemp(Registers& r) {
+        if (temps.size() <= r.base) {
+            throw std::runtime_error{"Top called on empty stack"};
+        }
+        return temps.back();
+    }
+
+    static std::int64_t integerOperand(const Code::Instruction& ins, std::size_t index) {
+        return static_cast<std::int32_t>(ins.operands[index]);
+    }
+
+    Handle constant(Registers& r, const Code::Instruction& ins, std::size_t index) {
+        return heap.GetHandle(constants(r)->GetItem(Integer(ins.operands[index])));
+    }
+
+    // only valid until the next allocation
+    Vector* constants(Registers& r) {
+        return code(r)->Constants().AsReference()->Value()->AsVector();
+    }
+
+    static std::int64_t integerArg(const std::vector<Handle>& args, std::size_t index) {
+        return args.at(index).Data().AsInteger()->Value();
+    }
+
+    #define DEFINE_ARITHMETIC_NATIVE(name, text, op) \
+        static Handle native_##name(VirtualMachine* vm, const std::vector<Handle>& args) { \
+            return vm->heap.GetHandle(Integer(integerArg(args, 0) op integerArg(args, 1))); \
+        }
+    PER_INTEGER_ARITHMETIC_NATIVE(DEFINE_ARITHMETIC_NATIVE)
+    #undef DEFINE_ARITHMETIC_NATIVE
+
+    #define DEFINE_COMPARISON_NATIVE(name, text, op) \
+        static Handle native_##name(VirtualMachine* vm, const std::vector<Handle>& args) { \
+            return vm->heap.GetHandle(Boolean(integerArg(args, 0) op integerArg(args, 1))); \
+        }
+    PER_INTEGER_COMPARISON_NATIVE(DEFINE_COMPARISON_NATIVE)
+    #undef DEFINE_COMPARISON_NATIVE
+
+    static Handle native_equal(VirtualMachine* vm, const std::vector<Handle>& args) {
+        return vm->heap.GetHandle(Boolean(Equality::Equal(args.at(0).Data(), args.at(1).Data())));
+    }
+
+    // shifted so it fits an Integer
+    static Handle native_equal_hash(VirtualMachine* vm, const std::vector<Handle>& args) {
+        std::uint64_t hash = Equality::Hash(args.at(0).Data());
+        return vm->heap.GetHandle(Integer(static_cast<std::int64_t>(hash >> 4)));
+    }
+
+    static Handle native_make_eq_hashtable(VirtualMachine* vm, const std::vector<Handle>& args) {
+        return vm->heap.NewEqHashtable();
+    }
+
+    // (hashtable-ref table key default)
+    static Handle native_hashtable_ref(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle table = args.at(0);
+        Primitive* found = EqHashtable::Find(table.AsEqHashtable(), args.at(1).Data());
+        if (found == nullptr) {
+            return args.at(2);
+        }
+        return vm->heap.GetHandle(*found);
+    }
+
+    static Handle native_hashtable_set(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle table = args.at(0);
+        table.AsEqHashtable();
+        EqHashtable::Insert(&vm->heap, table, args.at(1), args.at(2));
+        return vm->heap.GetHandle(Nil());
+    }
+
+    static Handle native_hashtable_delete(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle table = args.at(0);
+        EqHashtable::Remove(table.AsEqHashtable(), args.at(1).Data());
+        return vm->heap.GetHandle(Nil());
+    }
+
+    static Handle native_hashtable_size(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle table = args.at(0);
+        return vm->heap.GetHandle(table.AsEqHashtable()->Count());
+    }
+
+    // (make-record-type name #(field ...))
+    static Handle native_make_record_type(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle name = args.at(0);
+        Handle fields = args.at(1);
+        name.AsSymbol();
+        for (std::int64_t i = 0; i < fields.AsVector()->Length().Value(); i++) {
+            fields.AsVector()->GetItem(Integer(i)).AsSymbol();
+        }
+        return vm->heap.NewRecordType(name, fields);
+    }
+
+    // (record? value descriptor)
+    static Handle native_record_p(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle descriptor = args.at(1);
+        descriptor.AsRecordType();
+        return vm->heap.GetHandle(Boolean(isRecordOf(args.at(0).Data(), descriptor.Data())));
+    }
+
+    static Handle native_make_growable_vector(VirtualMachine* vm, const std::vector<Handle>& args) {
+        return vm->heap.NewGrowableVector();
+    }
+
+    static Handle native_growable_vector_push(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        vector.AsGrowableVector();
+        GrowableVector::Push(&vm->heap, vector, args.at(1));
+        return vm->heap.GetHandle(Nil());
+    }
+
+    static Handle native_growable_vector_pop(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        vector.AsGrowableVector();
+        return GrowableVector::Pop(&vm->heap, vector);
+    }
+
+    static Handle native_growable_vector_ref(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        return vm->heap.GetHandle(GrowableVector::Get(vector.AsGrowableVector(), Integer(integerArg(args, 1))));
+    }
+
+    static Handle native_growable_vector_set(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        GrowableVector::Set(vector.AsGrowableVector(), Integer(integerArg(args, 1)), args.at(2).Data());
+        return vm->heap.GetHandle(Nil());
+    }
+
+    static Handle native_growable_vector_length(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        return vm->heap.GetHandle(vector.AsGrowableVector()->Length());
+    }
+
+    static Handle native_growable_vector_to_vector(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        vector.AsGrowableVector();
+        return GrowableVector::ToVector(&vm->heap, vector);
+    }
+
+    static Handle native_make_string_builder(VirtualMachine* vm, const std::vector<Handle>& args) {
+        return vm->heap.NewStringBuilder();
+    }
+
+    // appends a string, rope or character
+    static Handle native_string_builder_append(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle builder = args.at(0);
+        builder.AsStringBuilder();
+        StringBuilder::Append(&vm->heap, builder, args.at(1));
+        return vm->heap.GetHandle(Nil());
+    }
+
+    static Handle native_string_builder_finish(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle builder = args.at(0);
+        builder.AsStringBuilder();
+        return StringBuilder::Finish(&vm->heap, builder);
+    }
+
+    static Handle native_make_persistent_map(VirtualMachine* vm, const std::vector<Handle>& args) {
+        return vm->heap.NewPersistentMap();
+    }
+
+    static Handle native_persistent_map_ref(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle map = args.at(0);
+        Primitive* found = PersistentMap::Find(map.AsPersistentMap(), args.at(1).Data());
+        if (found == nullptr) {
+            return args.at(2);
+        }
+        return vm->heap.GetHandle(*found);
+    }
+
+    // these and the vector updates below yield a new collection, or the
+    // collection itself when it is transient
+    static Handle native_persistent_map_assoc(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle map = args.at(0);
+        map.AsPersistentMap();
+        return PersistentMap::Assoc(&vm->heap, map, args.at(1), args.at(2));
+    }
+
+    static Handle native_persistent_map_dissoc(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle map = args.at(0);
+        map.AsPersistentMap();
+        return PersistentMap::Dissoc(&vm->heap, map, args.at(1));
+    }
+
+    static Handle native_persistent_map_count(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle map = args.at(0);
+        return vm->heap.GetHandle(map.AsPersistentMap()->Count());
+    }
+
+    static Handle native_make_persistent_vector(VirtualMachine* vm, const std::vector<Handle>& args) {
+        return vm->heap.NewPersistentVector();
+    }
+
+    static Handle native_persistent_vector_ref(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        return vm->heap.GetHandle(PersistentVector::Get(vector.AsPersistentVector(), Integer(integerArg(args, 1))));
+    }
+
+    static Handle native_persistent_vector_set(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        vector.AsPersistentVector();
+        return PersistentVector::Set(&vm->heap, vector, Integer(integerArg(args, 1)), args.at(2));
+    }
+
+    static Handle native_persistent_vector_conj(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        vector.AsPersistentVector();
+        return PersistentVector::Push(&vm->heap, vector, args.at(1));
+    }
+
+    static Handle native_persistent_vector_length(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle vector = args.at(0);
+        return vm->heap.GetHandle(vector.AsPersistentVector()->Length());
+    }
+
+    static bool isPersistentMap(Handle collection) {
+        return collection.Data().GetType() == Primitive::Type::Reference
+            && collection.Data().AsReference()->Value()->IsPersistentMap();
+    }
+
+    static bool isPersistentVector(Handle collection) {
+        return collection.Data().GetType() == Primitive::Type::Reference
+            && collection.Data().AsReference()->Value()->IsPersistentVector();
+    }
+
+    static Handle native_transient(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle collection = args.at(0);
+        if (isPersistentMap(collection)) {
+            return PersistentMap::Transient(&vm->heap, collection);
+        }
+        if (isPersistentVector(collection)) {
+            return PersistentVector::Transient(&vm->heap, collection);
+        }
+        throw std::runtime_error{"Expected a persistent map or vector"};
+    }
+
+    static Handle native_persistent(VirtualMachine* vm, const std::vector<Handle>& args) {
+        Handle collection = args.at(0);
+        if (isPersistentMap(collection)) {
+            PersistentMap::Persistent(collection);
+        } else if (isPersistentVector(collection)) {
+            PersistentVector::Persistent(collection);
+        } else {
+            throw std::runtime_error{"Expected a persistent map or vector"};
+        }
+        return collection;
+    }
+
+    void DefineControl(std::string_view name, std::int64_t arity, ControlFunctionPointer fn) {
+        DefineNative(name, arity, nullptr);
+        controls.back() = fn;
+    }
+
+    void registerNatives() {
+        #define REGISTER(name, text, op) \
+            DefineNative(text, 2, native_##name); \
+            quickenings.back() = WellKnownSymbols::opcode_invoke##name;
+        PER_INTEGER_ARITHMETIC_NATIVE(REGISTER)
+        PER_INTEGER_COMPARISON_NATIVE(REGISTER)
+        #undef REGISTER
+        DefineNative("equal?", 2, native_equal);
+        DefineNative("equal-hash", 1, native_equal_hash);
+        DefineNative("make-eq-hashtable", 0, native_make_eq_hashtable);
+        DefineNative("hashtable-ref", 3, native_hashtable_ref);
+        DefineNative("hashtable-set!", 3, native_hashtable_set);
+        DefineNative("hashtable-delete!", 2, native_hashtable_delete);
+        DefineNative("hashtable-size", 1, native_hashtable_size);
+        DefineNative("make-record-type", 2, native_make_record_type);
+        DefineNative("record?", 2, native_record_p);
+        DefineNative("make-growable-vector", 0, native_make_growable_vector);
+        DefineNative("growable-vector-push!", 2, native_growable_vector_push);
+        DefineNative("growable-vector-pop!", 1, native_growable_vector_pop);
+        DefineNative("growable-vector-ref", 2, native_growable_vector_ref);
+        DefineNative("growable-vector-set!", 3, native_growable_vector_set);
+        DefineNative("growable-vector-length", 1, native_growable_vector_length);
+        DefineNative("growable-vector->vector", 1, native_growable_vector_to_vector);
+        DefineNative("make-string-builder", 0, native_make_string_builder);
+        DefineNative("string-builder-append!", 2, native_string_builder_append);
+        DefineNative("string-builder-finish", 1, native_string_builder_finish);
+        DefineNative("make-persistent-map", 0, native_make_persistent_map);
+        DefineNative("persistent-map-ref", 3, native_persistent_map_ref);
+        DefineNative("persistent-map-assoc", 3, native_persistent_map_assoc);
+        DefineNative("persistent-map-dissoc", 2, native_persistent_map_dissoc);
+        DefineNative("persistent-map-count", 1, native_persistent_map_count);
+        DefineNative("make-persistent-vector", 0, native_make_persistent_vector);
+        DefineNative("persistent-vector-ref", 2, native_persistent_vector_ref);
+        DefineNative("persistent-vector-set", 3, native_persistent_vector_set);
+        DefineNative("persistent-vector-conj", 2, native_persistent_vector_conj);
+        DefineNative("persistent-vector-length", 1, native_persistent_vector_length);
+        DefineNative("transient", 1, native_transient);
+        DefineNative("persistent!", 1, native_persistent);
+        DefineControl("call-with-current-continuation", 1, &VirtualMachine::control_call_cc);
+        DefineControl("call/cc", 1, &VirtualMachine::control_call_cc);
+        DefineControl("call-with-escape-continuation", 1, &VirtualMachine::control_call_ec);
+        DefineControl("call/ec", 1, &VirtualMachine::control_call_ec);
+        DefineControl("call-with-continuation-prompt", 2, &VirtualMachine::control_call_with_prompt);
+        DefineControl("abort-current-continuation", 2, &VirtualMachine::control_abort);
+        DefineControl("call-with-delimited-continuation", 2, &VirtualMachine::control_call_with_delimited);
+    }
 };
 
-#endif // OBJECTS_VM_HH__
\ No newline at end of file
+#endif // OBJECTS_VM_HH__
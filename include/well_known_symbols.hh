@@ -0,0 +1,142 @@
+#ifndef WELL_KNOWN_SYMBOLS_HH__
+#define WELL_KNOWN_SYMBOLS_HH__
+
+#include "lib.hh"
+
+/*
+    Opcodes and the format of their operands, one letter per operand
+        k - constant, kept in the constant pool of the code
+        c - instruction list, lowered into Code of its own in the pool
+        i - integer
+        j - jump offset, in instructions from the jump before lowering and
+            in bytes from the next instruction after
+        b - boolean
+        s - inline cache of a call site, a constant pool entry that is nil
+            until the instruction first runs and not in the list form
+
+    The opcodes after halt are quickened variants, specialized for the
+    operands an instruction was seen with. The interpreter rewrites
+    instructions into them in place and back when their guard fails, so
+    each has the format of the instruction it stands in for. They never
+    appear in the list form.
+*/
+#define PER_OPCODE(V) \
+    V(load, "k") \
+    V(loadlocal, "ii") \
+    V(storelocal, "ii") \
+    V(loadfree, "i") \
+    V(box, "i") \
+    V(unbox, "") \
+    V(setbox, "") \
+    V(loadglobal, "k") \
+    V(setglobal, "k") \
+    V(defineglobal, "k") \
+    V(define, "k") \
+    V(set, "k") \
+    V(invoke, "is") \
+    V(lambda, "kciib") \
+    V(literal, "k") \
+    V(makerecord, "i") \
+    V(recordref, "i") \
+    V(recordset, "i") \
+    V(pop, "") \
+    V(invoketail, "is") \
+    V(jumpiffalse, "j") \
+    V(jump, "j") \
+    V(return, "") \
+    V(halt, "") \
+    V(loadglobalcell, "k") \
+    V(invokeadd, "is") \
+    V(invokesubtract, "is") \
+    V(invokemultiply, "is") \
+    V(invokeequals, "is") \
+    V(invokeless, "is") \
+    V(invokegreater, "is")
+
+// special forms whose names are not already opcodes
+#define PER_SPECIAL_FORM(V) \
+    V(quote, "quote") \
+    V(if, "if") \
+    V(begin, "begin") \
+    V(let, "let") \
+    V(letrec, "letrec") \
+    V(cond, "cond") \
+    V(else, "else") \
+    V(and, "and") \
+    V(or, "or") \
+    V(set_bang, "set!")
+
+/*
+    Symbols with ids reserved at compile time. SymbolTable interns these
+    first and in this order, so the id of every opcode and special form is
+    known statically and opcodes can be recognized with a dense switch.
+*/
+class WellKnownSymbols {
+public:
+    enum Id : std::uint64_t {
+        #define ADD_OPCODE(v, operands) opcode_##v,
+        PER_OPCODE(ADD_OPCODE)
+        #undef ADD_OPCODE
+        #define ADD_FORM(name, text) form_##name,
+        PER_SPECIAL_FORM(ADD_FORM)
+        #undef ADD_FORM
+        COUNT
+    };
+
+    constexpr static std::array<std::string_view, COUNT> NAMES = {
+        #define ADD_OPCODE(v, operands) #v,
+        PER_OPCODE(ADD_OPCODE)
+        #undef ADD_OPCODE
+        #define ADD_FORM(name, text) text,
+        PER_SPECIAL_FORM(ADD_FORM)
+        #undef ADD_FORM
+    };
+
+    constexpr static std::size_t OPCODE_COUNT = form_quote;
+
+    constexpr static std::array<std::string_view, OPCODE_COUNT> OPERANDS = {
+        #define ADD_OPCODE(v, operands) operands,
+        PER_OPCODE(ADD_OPCODE)
+        #undef ADD_OPCODE
+    };
+
+    constexpr static std::size_t MaxOperandCount() {
+        std::size_t result = 0;
+        for (std::string_view operands : OPERANDS) {
+            result = std::max(result, operands.size());
+        }
+        return result;
+    }
+
+    constexpr static bool IsOpcode(std::uint64_t id) {
+        return id < OPCODE_COUNT;
+    }
+
+    constexpr static bool IsQuickened(std::uint64_t id) {
+        return id > opcode_halt && id < OPCODE_COUNT;
+    }
+
+    // whether running the opcode may hand control to another frame
+    constexpr static bool TransfersControl(std::uint64_t id) {
+        return id == opcode_invoke
+            || id == opcode_invoketail
+            || id == opcode_return
+            || (IsQuickened(id) && id != opcode_loadglobalcell);
+    }
+
+    constexpr static bool NamesAreUnique() {
+        for (std::size_t i = 0; i < COUNT; i++) {
+            for (std::size_t j = i + 1; j < COUNT; j++) {
+                if (NAMES[i] == NAMES[j]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+static_assert(WellKnownSymbols::NamesAreUnique(), "well known symbol names must be unique");
+static_assert(WellKnownSymbols::OPCODE_COUNT <= 256, "opcodes are encoded in a byte");
+
+#endif // WELL_KNOWN_SYMBOLS_HH__
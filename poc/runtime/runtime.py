@@ -53,13 +53,21 @@ class Pair:
         return str(self)
 
 class Environment:
-    def __init__(self, outer):
+    def __init__(self, outer, slots=0):
         self._lookup = {}
         self.outer = outer
+        self.slots = [NIL] * slots
+    def resolve(self, depth):
+        e = self
+        for _ in range(depth):
+            e = e.outer
+        return e
     def define(self, key, value):
         if type(key) is not Symbol:
             raise Exception('Can only define symbols')
         self._lookup[key] = value
+    def is_bound(self, key):
+        return key in self._lookup
     @property
     def locals(self):
         return self._lookup.keys()
@@ -77,13 +85,43 @@ class Environment:
     def __repr__(self):
         return str(self)
 
+class Box:
+    def __init__(self, value):
+        self.value = value
+    def __str__(self):
+        return f'(box {self.value})'
+    def __repr__(self):
+        return str(self)
+
+class RecordType:
+    def __init__(self, name, fields):
+        self.name = name
+        self.fields = fields
+    def __str__(self):
+        return f'(record-type {self.name})'
+    def __repr__(self):
+        return str(self)
+
+class Record:
+    def __init__(self, descriptor, values):
+        self.descriptor = descriptor
+        self.values = values
+    def __str__(self):
+        return f'(record {self.descriptor.name} {self.values})'
+    def __repr__(self):
+        return str(self)
+
 class Frame:
-    def __init__(self, bc, env, outer):
+    def __init__(self, bc, env, outer, closure=None):
         self.bc = bc
         self.pc = 0
         self.env = env
         self.outer = outer
         self.temps = []
+        # lambda being run, its free values are read by loadfree
+        self.closure = closure
+        # tag of the prompt this frame was called under, if any
+        self.prompt = None
     @property
     def locals(self):
         return self.env.locals
@@ -101,10 +139,13 @@ class Frame:
         self.env.define(key, val)
 
 class Lambda:
-    def __init__(self, args, bc, env):
+    def __init__(self, args, bc, env, nlocals=None, free=None):
         self._args = args
         self._bc = bc
         self._env = env
+        # None for lambdas compiled before lexical addressing
+        self._nlocals = nlocals
+        self._free = free
     @property
     def args(self):
         return self._args
@@ -114,6 +155,12 @@ class Lambda:
     @property
     def env(self):
         return self._env
+    @property
+    def nlocals(self):
+        return self._nlocals
+    @property
+    def free(self):
+        return self._free
     def __str__(self):
         return f'(lambda)'
     def __repr__(self):
@@ -145,6 +192,37 @@ class Continuation:
     def __repr__(self):
         return str(self)
 
+class DelimitedContinuation:
+    def __init__(self, top, bottom):
+        self._top = top
+        self._bottom = bottom
+    @property
+    def top(self):
+        return self._top
+    @property
+    def bottom(self):
+        return self._bottom
+    def __str__(self):
+        return '(delimited-continuation)'
+    def __repr__(self):
+        return str(self)
+
+def copy_frames(top, bottom, outer):
+    # copies of the frames from top down to bottom, with bottom's copy
+    # returning to outer, frames are changed as they run so a continuation
+    # that is resumed more than once needs fresh ones every time
+    frames = [top]
+    while frames[-1] is not bottom:
+        frames.append(frames[-1].outer)
+    copy = outer
+    for frame in reversed(frames):
+        inner = Frame(frame.bc, frame.env, copy, frame.closure)
+        inner.pc = frame.pc
+        inner.temps = list(frame.temps)
+        inner.prompt = frame.prompt
+        copy = inner
+    return copy
+
 class Runtime:
     def __init__(self):
         self.symbols = {}
@@ -152,11 +230,23 @@ class Runtime:
 
         # intial interned symbols
         self._load = self.intern('load')
+        self._loadlocal = self.intern('loadlocal')
+        self._storelocal = self.intern('storelocal')
+        self._loadfree = self.intern('loadfree')
+        self._box = self.intern('box')
+        self._unbox = self.intern('unbox')
+        self._setbox = self.intern('setbox')
+        self._loadglobal = self.intern('loadglobal')
+        self._setglobal = self.intern('setglobal')
+        self._defineglobal = self.intern('defineglobal')
         self._define = self.intern('define')
         self._set = self.intern('set')
         self._invoke = self.intern('invoke')
         self._lambda_ = self.intern('lambda')
         self._literal = self.intern('literal')
+        self._makerecord = self.intern('makerecord')
+        self._recordref = self.intern('recordref')
+        self._recordset = self.intern('recordset')
         self._pop = self.intern('pop')
         self._invoketail = self.intern('invoketail')
         self._jumpiffalse = self.intern('jumpiffalse')
@@ -165,11 +255,23 @@ class Runtime:
 
         self.dispatch = {
             self._load: self.load,
+            self._loadlocal: self.loadlocal,
+            self._storelocal: self.storelocal,
+            self._loadfree: self.loadfree,
+            self._box: self.box,
+            self._unbox: self.unbox,
+            self._setbox: self.setbox,
+            self._loadglobal: self.loadglobal,
+            self._setglobal: self.setglobal,
+            self._defineglobal: self.defineglobal,
             self._define: self.define,
             self._set: self.set,
             self._invoke: self.invoke,
             self._lambda_: self.lambda_,
             self._literal: self.literal,
+            self._makerecord: self.makerecord,
+            self._recordref: self.recordref,
+            self._recordset: self.recordset,
             self._pop: self.pop,
             self._invoketail: self.invoketail,
             self._jumpiffalse: self.jumpiffalse,
@@ -238,6 +340,66 @@ class Runtime:
         frame.push(val)
         return frame
 
+    def loadlocal(self, frame, op, bc):
+        frame.pc += 1
+        depth = bc.second.first
+        index = bc.second.second.first
+        frame.push(frame.env.resolve(depth).slots[index])
+        return frame
+
+    def storelocal(self, frame, op, bc):
+        frame.pc += 1
+        val = frame.pop()
+        depth = bc.second.first
+        index = bc.second.second.first
+        frame.env.resolve(depth).slots[index] = val
+        frame.push(NIL)
+        return frame
+
+    def loadfree(self, frame, op, bc):
+        frame.pc += 1
+        frame.push(frame.closure.free[bc.second.first])
+        return frame
+
+    def box(self, frame, op, bc):
+        frame.pc += 1
+        index = bc.second.first
+        frame.env.slots[index] = Box(frame.env.slots[index])
+        return frame
+
+    def unbox(self, frame, op, bc):
+        frame.pc += 1
+        frame.push(frame.pop().value)
+        return frame
+
+    def setbox(self, frame, op, bc):
+        frame.pc += 1
+        val = frame.pop()
+        frame.pop().value = val
+        frame.push(NIL)
+        return frame
+
+    def loadglobal(self, frame, op, bc):
+        frame.pc += 1
+        frame.push(self.globalenv.lookup(bc.second.first))
+        return frame
+
+    def setglobal(self, frame, op, bc):
+        frame.pc += 1
+        # only defineglobal binds, the same as the vm
+        name = bc.second.first
+        if not self.globalenv.is_bound(name):
+            raise Exception(f'Unbound variable: {name}')
+        self.globalenv.define(name, frame.pop())
+        frame.push(NIL)
+        return frame
+
+    def defineglobal(self, frame, op, bc):
+        frame.pc += 1
+        self.globalenv.define(bc.second.first, frame.pop())
+        frame.push(NIL)
+        return frame
+
     def define(self, frame, op, bc):
         frame.pc += 1
         val = frame.pop()
@@ -271,10 +433,18 @@ class Runtime:
         #print('Reciever', reciever)
         if type(reciever) is Lambda:
             # create a closure
-            innerframe = Frame(reciever.bc, Environment(reciever.env), returnframe)
-            for argname, argval in zip(reciever.args, args):
-                #print(f'Defining {argname} <- {argval}')
-                innerframe.define(argname, argval)
+            if reciever.nlocals is None:
+                innerframe = Frame(reciever.bc, Environment(reciever.env), returnframe)
+                for argname, argval in zip(reciever.args, args):
+                    #print(f'Defining {argname} <- {argval}')
+                    innerframe.define(argname, argval)
+            else:
+                innerenv = Environment(reciever.env, reciever.nlocals)
+                innerenv.slots[:len(args)] = args
+                innerframe = Frame(reciever.bc, innerenv, returnframe, reciever)
+            if returnframe is not frame:
+                # a tail call stays under the prompt of the frame it replaces
+                innerframe.prompt = frame.prompt
             return innerframe
         elif type(reciever) is NativeFunction:
             innerenv = Environment(self.globalenv)
@@ -290,6 +460,12 @@ class Runtime:
             frame = reciever.frame
             frame.push(args[0])
             return frame
+        elif type(reciever) is DelimitedContinuation:
+            if len(args) != 1:
+                raise Exception('Continuation takes 1 argument')
+            frame = copy_frames(reciever.top, reciever.bottom, returnframe)
+            frame.push(args[0])
+            return frame
         else:
             raise Exception(f'Cannot invoke {type(reciever)}')
         
@@ -325,11 +501,52 @@ class Runtime:
         frame.pc += 1
         args = bc.second.first
         innerbc = bc.second.second.first
-        l = Lambda(args, innerbc, frame.env)
+        nlocals = bc.second.second.second
+        nfree = NIL if nlocals is NIL else nlocals.second
+        nlocals = None if nlocals is NIL else nlocals.first
+        free = None
+        if nfree is not NIL:
+            # flat closure over the captured values pushed before it
+            free = [NIL] * nfree.first
+            for i in reversed(range(len(free))):
+                free[i] = frame.pop()
+        l = Lambda(args, innerbc, frame.env, nlocals, free)
         #print(l)
         frame.push(l)
         return frame
 
+    def makerecord(self, frame, op, bc):
+        frame.pc += 1
+        count = bc.second.first
+        values = [frame.pop() for _ in range(count)]
+        values.reverse()
+        descriptor = frame.pop()
+        if len(descriptor.fields) != count:
+            raise Exception(f'Record has {len(descriptor.fields)} fields but was made with {count}')
+        frame.push(Record(descriptor, values))
+        return frame
+
+    def checked_record(self, record, descriptor):
+        if type(record) is not Record or record.descriptor is not descriptor:
+            raise Exception(f'Expected a record of type {descriptor.name}')
+        return record
+
+    def recordref(self, frame, op, bc):
+        frame.pc += 1
+        descriptor = frame.pop()
+        record = frame.pop()
+        frame.push(self.checked_record(record, descriptor).values[bc.second.first])
+        return frame
+
+    def recordset(self, frame, op, bc):
+        frame.pc += 1
+        val = frame.pop()
+        descriptor = frame.pop()
+        record = frame.pop()
+        self.checked_record(record, descriptor).values[bc.second.first] = val
+        frame.push(NIL)
+        return frame
+
     def literal(self, frame, op, bc):
         frame.pc += 1
         value = bc.second.first
@@ -414,9 +631,75 @@ class Runtime:
             if len(arg0val.args) != 1:
                 raise Exception(f'Argument to contuation must be a lambda with 1 argument, got {len(arg0val.args)}')
             continuation = Continuation(frame)
-            innerenv = Environment(arg0val.env)
-            innerenv.define(arg0val.args[0], continuation)
-            nextframe = Frame(arg0val.bc, innerenv, frame)
+            if arg0val.nlocals is None:
+                innerenv = Environment(arg0val.env)
+                innerenv.define(arg0val.args[0], continuation)
+            else:
+                innerenv = Environment(arg0val.env, arg0val.nlocals)
+                innerenv.slots[0] = continuation
+            nextframe = Frame(arg0val.bc, innerenv, frame, arg0val)
             return nextframe
 
         self.globalenv.define(self.intern('call-with-current-continuation'), NativeFunction([arg0], callcc))
+        # frames here are never reused, so a full continuation also serves
+        # as an escape continuation
+        self.globalenv.define(self.intern('call-with-escape-continuation'), NativeFunction([arg0], callcc))
+        self.globalenv.define(self.intern('call/ec'), NativeFunction([arg0], callcc))
+
+        def call_lambda(fn, args, returnframe):
+            if type(fn) is not Lambda:
+                raise Exception(f'Expected a lambda: {type(fn)}')
+            if fn.nlocals is None:
+                innerenv = Environment(fn.env)
+                for argname, argval in zip(fn.args, args):
+                    innerenv.define(argname, argval)
+            else:
+                innerenv = Environment(fn.env, fn.nlocals)
+                innerenv.slots[:len(args)] = args
+            return Frame(fn.bc, innerenv, returnframe, fn)
+
+        def find_prompt(frame, tag):
+            while frame is not None and frame.prompt != tag:
+                frame = frame.outer
+            if frame is None:
+                raise Exception(f'No continuation prompt for {tag}')
+            return frame
+
+        def call_with_prompt(frame, env):
+            innerframe = call_lambda(env.lookup(arg0), [], frame)
+            innerframe.prompt = env.lookup(arg1)
+            return innerframe
+
+        def abort(frame, env):
+            prompt = find_prompt(frame, env.lookup(arg0))
+            prompt.outer.push(env.lookup(arg1))
+            return prompt.outer
+
+        def call_with_delimited(frame, env):
+            tag = env.lookup(arg1)
+            prompt = find_prompt(frame, tag)
+            top = copy_frames(frame, prompt, None)
+            bottom = top
+            while bottom.outer is not None:
+                bottom = bottom.outer
+            innerframe = call_lambda(env.lookup(arg0), [DelimitedContinuation(top, bottom)], prompt.outer)
+            innerframe.prompt = tag
+            return innerframe
+
+        self.globalenv.define(self.intern('call-with-continuation-prompt'), NativeFunction([arg0, arg1], call_with_prompt))
+        self.globalenv.define(self.intern('abort-current-continuation'), NativeFunction([arg0, arg1], abort))
+        self.globalenv.define(self.intern('call-with-delimited-continuation'), NativeFunction([arg0, arg1], call_with_delimited))
+
+        def make_record_type(frame, env):
+            fields = env.lookup(arg1)
+            frame.push(RecordType(env.lookup(arg0), [fields[i] for i in range(len(fields))]))
+            return frame
+
+        self.globalenv.define(self.intern('make-record-type'), NativeFunction([arg0, arg1], make_record_type))
+
+        def record_p(frame, env):
+            record = env.lookup(arg0)
+            frame.push(type(record) is Record and record.descriptor is env.lookup(arg1))
+            return frame
+
+        self.globalenv.define(self.intern('record?'), NativeFunction([arg0, arg1], record_p))
@@ -13,98 +13,512 @@ import uuid
 # 9  INVOKE
 # 10 INVOKETAIL
 
-class Symbol:
+class Scope:
+    """
+    Lexical scope of a lambda body. Variables are its parameters followed
+    by its internal defines, a variable's position is its slot index.
+
+    Free are the variables of enclosing lambdas that this one captures, in
+    the order they are copied into the closure. Boxed variables are
+    captured by an inner lambda and also assigned, so their slot holds a
+    box that is shared with the closures instead of the value itself.
+    """
+    def __init__(self, variables, boxed, outer):
+        self.variables = variables
+        self.boxed = boxed
+        self.outer = outer
+        self.free = []
+    def index(self, name):
+        return self.variables.index(name)
+    def binds(self, name):
+        scope = self
+        while scope is not None:
+            if name in scope.variables:
+                return True
+            scope = scope.outer
+        return False
+    def is_boxed(self, name):
+        scope = self
+        while name not in scope.variables:
+            scope = scope.outer
+        return name in scope.boxed
+    def lookup(self, name):
+        # ('local', slot), ('free', index) or None if it is not lexically bound
+        if name in self.variables:
+            return ('local', self.index(name))
+        if name not in self.free:
+            if self.outer is None or not self.outer.binds(name):
+                return None
+            self.free.append(name)
+        return ('free', self.free.index(name))
+
+# natives that capture the frames of their caller
+CAPTURES_CONTINUATION = {'call-with-current-continuation', 'call/cc'}
+# native that only marks the frame it calls, for continuations that can
+# never be used after the call returns
+ESCAPE_CONTINUATION = 'call/ec'
+# prompt tag of reset and shift when none is given
+DEFAULT_PROMPT_TAG = 'reset'
+# natives that never call back into code, so calling them cannot capture
+# a continuation
+NEVER_CAPTURES = {
+    '=', '<', '>', '+', '-', '*', '/', 'not', 'display', 'newline',
+    'equal?', 'equal-hash', 'record?', 'make-record-type',
+}
+
+def only_called(node, name):
+    # whether name is only ever read as the operator of a call in node,
+    # a lambda that refers to it at all could keep it past the call
+    if isinstance(node, Symbol):
+        return node.value != name
+    if isinstance(node, Lambda):
+        return name not in node.references()
+    if isinstance(node, Invoke) and isinstance(node.exprs[0], Symbol) and node.exprs[0].value == name:
+        return all(only_called(expr, name) for expr in node.exprs[1:])
+    return all(only_called(child, name) for child in node.children())
+
+def may_capture(node, k, shadowed):
+    # whether evaluating node could capture a continuation, calls to k
+    # aside. a lambda is only made, not run, and calls are only known not
+    # to capture when they go to a native in NEVER_CAPTURES that is not
+    # shadowed by a local
+    if isinstance(node, Lambda):
+        return False
+    if isinstance(node, Invoke):
+        head = node.exprs[0]
+        if not isinstance(head, Symbol):
+            return True
+        if head.value != k and (head.value not in NEVER_CAPTURES or shadowed(head.value)):
+            return True
+        return any(may_capture(expr, k, shadowed) for expr in node.exprs[1:])
+    return any(may_capture(child, k, shadowed) for child in node.children())
+
+def top_level(node):
+    # the nodes a program runs at the top level, in order
+    if isinstance(node, Sequence):
+        return [n for expr in node.exprs for n in top_level(expr)]
+    return [node]
+
+def assigned(node, name):
+    # whether name is the target of any set! in node, shadowed or not
+    if isinstance(node, Set) and node.symbol.value == name:
+        return True
+    return any(assigned(child, name) for child in node.children())
+
+def record_access(expr):
+    # accessors and modifiers of the record types defined at the top level
+    # of a program, by name, as (descriptor, index, modifies). only names
+    # nothing else defines or assigns, so calling the global always
+    # reaches the lambda the record definition made
+    defined = expr.defines()
+    known = lambda name: defined.count(name) == 1 and not assigned(expr, name)
+    access = {}
+    for node in top_level(expr):
+        if not isinstance(node, DefineRecordType) or not known(node.name.value):
+            continue
+        for index, field in enumerate(node.fields):
+            if known(field[1].value):
+                access[field[1].value] = (node.name.value, index, False)
+            if len(field) > 2 and known(field[2].value):
+                access[field[2].value] = (node.name.value, index, True)
+    return access
+
+def mark_record_access(node, access):
+    # calls to the accessors and modifiers in access with the right number
+    # of arguments, they are compiled inline where the name is not shadowed
+    if isinstance(node, Invoke) and isinstance(node.exprs[0], Symbol) and node.exprs[0].value in access:
+        descriptor, index, modifies = access[node.exprs[0].value]
+        if len(node.exprs) == (3 if modifies else 2):
+            node.record_access = (descriptor, index, modifies)
+    for child in node.children():
+        mark_record_access(child, access)
+
+def load(scope, name, unbox=True):
+    address = scope.lookup(name) if scope is not None else None
+    if address is None:
+        return [(Symbol('loadglobal'), Symbol(name))]
+    kind, index = address
+    if kind == 'local':
+        bc = [(Symbol('loadlocal'), 0, index)]
+    else:
+        bc = [(Symbol('loadfree'), index)]
+    if unbox and scope.is_boxed(name):
+        bc.append((Symbol('unbox'),))
+    return bc
+
+def store(scope, name, value):
+    address = scope.lookup(name) if scope is not None else None
+    if address is None:
+        return value + [(Symbol('setglobal'), Symbol(name))]
+    if scope.is_boxed(name):
+        return load(scope, name, unbox=False) + value + [(Symbol('setbox'),)]
+    kind, index = address
+    if kind != 'local':
+        raise Exception(f'{name} is captured but was not boxed')
+    return value + [(Symbol('storelocal'), 0, index)]
+
+class Node:
+    """
+    Free variable analysis over the children of a node. Lambdas stop the
+    walk for the names they bind.
+    """
+    def children(self):
+        return []
+    def references(self):
+        # names read or assigned here that are not bound here
+        return set().union(*[c.references() for c in self.children()])
+    def assignments(self):
+        # names assigned here that are not bound here
+        return set().union(*[c.assignments() for c in self.children()])
+    def captures(self):
+        # free names of the lambdas directly nested in this node
+        return set().union(*[c.captures() for c in self.children()])
+    def continuation_references(self):
+        # like references, leaving out the call/cc of calls that become
+        # call/ec
+        return set().union(*[c.continuation_references() for c in self.children()])
+
+class Symbol(Node):
     def __init__(self, value):
         self.value = value
-    def compile(self, in_tail_pos):
-        return [
-            (Symbol('load'), Symbol(self.value))
-        ]
+    def compile(self, in_tail_pos, scope=None):
+        return load(scope, self.value)
+    def defines(self):
+        return []
+    def references(self):
+        return {self.value}
+    def continuation_references(self):
+        return {self.value}
     def __repr__(self):
         return self.value
     def __str__(self):
         return self.value
-class Program:
+class Global(Symbol):
+    # a global, read as one even where a local of the same name is in scope
+    def compile(self, in_tail_pos, scope=None):
+        return load(None, self.value)
+class Program(Node):
     def __init__(self, expr):
         self.expr = expr
-    def compile(self, in_tail_pos):
-        bc = self.expr.compile(False)
+    def compile(self, in_tail_pos, scope=None):
+        mark_record_access(self.expr, record_access(self.expr))
+        bc = self.expr.compile(False, scope)
         bc.append((Symbol('pop'),))
         return bc
-class Sequence:
+    def defines(self):
+        return []
+    def children(self):
+        return [self.expr]
+class Sequence(Node):
     def __init__(self, exprs):
         self.exprs = exprs
-    def compile(self, in_tal_pos):
+    def compile(self, in_tal_pos, scope=None):
         bc = []
         for idx, expr in enumerate(self.exprs):
             if idx < len(self.exprs) - 1:
                 # intermediate ones are not ever in tail position
-                bc += expr.compile(False)
+                bc += expr.compile(False, scope)
                 bc.append((Symbol('pop'),))
             else:
                 # if this is in tail position, then it's only in tail pos
                 # if the parent is also
-                bc += expr.compile(in_tal_pos)
+                bc += expr.compile(in_tal_pos, scope)
         return bc
-class Literal:
+    def defines(self):
+        return [d for expr in self.exprs for d in expr.defines()]
+    def children(self):
+        return self.exprs
+class Literal(Node):
     def __init__(self, value):
         self.value = value 
-    def compile(self, _in_tail_pos):
+    def compile(self, _in_tail_pos, scope=None):
         return [(Symbol('literal'), self.value)]
-class Define:
+    def defines(self):
+        return []
+class Define(Node):
     def __init__(self, symbol, expr):
         self.symbol = symbol
         self.expr = expr
-    def compile(self, _in_tail_pos):
-        bc = self.expr.compile(False) # never in tail pos
-        bc.append((Symbol('define'), self.symbol))
-        return bc
-class Set:
+    def compile(self, _in_tail_pos, scope=None):
+        bc = self.expr.compile(False, scope) # never in tail pos
+        if scope is None:
+            bc.append((Symbol('defineglobal'), self.symbol))
+            return bc
+        # internal defines were given a slot when the lambda was compiled
+        return store(scope, self.symbol.value, bc)
+    def defines(self):
+        return [self.symbol.value] + self.expr.defines()
+    def children(self):
+        return [self.expr]
+    def references(self):
+        return {self.symbol.value} | self.expr.references()
+    def assignments(self):
+        # a captured internal define is stored after the closures that
+        # refer to it may have been made, so it is treated as assigned
+        return {self.symbol.value} | self.expr.assignments()
+class Set(Node):
     def __init__(self, symbol, expr):
         self.symbol = symbol
         self.expr = expr
-    def compile(self, _in_tail_pos):
-        bc = self.expr.compile(False) # never in tail pos
-        bc.append((Symbol('set'), self.symbol))
-        return bc
-class Lambda:
+    def compile(self, _in_tail_pos, scope=None):
+        bc = self.expr.compile(False, scope) # never in tail pos
+        return store(scope, self.symbol.value, bc)
+    def defines(self):
+        return self.expr.defines()
+    def children(self):
+        return [self.expr]
+    def references(self):
+        return {self.symbol.value} | self.expr.references()
+    def assignments(self):
+        return {self.symbol.value} | self.expr.assignments()
+class Lambda(Node):
     def __init__(self, params, expr):
         self.params = params
         self.expr = expr
-    def compile(self, _in_tail_pos):
-        inner = self.expr.compile(True) # lambda has one expression, always in
+    def variables(self):
+        variables = [p.value for p in self.params]
+        for name in self.expr.defines():
+            if name not in variables:
+                variables.append(name)
+        return variables
+    def compile(self, _in_tail_pos, scope=None):
+        variables = self.variables()
+        captured = self.expr.captures()
+        assigned = self.expr.assignments()
+        boxed = [v for v in variables if v in captured and v in assigned]
+        inner_scope = Scope(variables, boxed, scope)
+        inner = [(Symbol('box'), inner_scope.index(name)) for name in boxed]
+        inner += self.expr.compile(True, inner_scope) # lambda has one expression, always in
         inner.append((Symbol('return'),))
-        return [
-            (Symbol('lambda'), self.params, inner)
-        ]
-class If:
+        # the closure is made from the captured variables pushed in order,
+        # boxes are copied as they are so assignments stay shared
+        bc = []
+        for name in inner_scope.free:
+            bc += load(scope, name, unbox=False)
+        bc.append((Symbol('lambda'), self.params, inner, len(variables), len(inner_scope.free), self.escapes()))
+        return bc
+    def escapes(self):
+        # locals are kept in the vm's native locals region unless they are
+        # certain to be captured, anything else that needs them promotes them
+        return len(CAPTURES_CONTINUATION & self.continuation_references()) > 0
+    def defines(self):
+        # defines inside belong to the lambda's own scope
+        return []
+    def references(self):
+        return self.expr.references() - set(self.variables())
+    def continuation_references(self):
+        return self.expr.continuation_references() - set(self.variables())
+    def children(self):
+        # for walks over the whole program, the analyses above are
+        # overridden to account for what the lambda binds
+        return [self.expr]
+    def assignments(self):
+        return self.expr.assignments() - set(self.variables())
+    def captures(self):
+        return self.references()
+class If(Node):
     def __init__(self, test, ontrue, onfalse):
         self.test = test
         self.ontrue = ontrue
         self.onfalse = onfalse
-    def compile(self, in_tail_pos):
+    def compile(self, in_tail_pos, scope=None):
         bc = []
-        test = self.test.compile(False)
-        ontrue = self.ontrue.compile(in_tail_pos)
-        onfalse = self.onfalse.compile(in_tail_pos)
+        test = self.test.compile(False, scope)
+        ontrue = self.ontrue.compile(in_tail_pos, scope)
+        onfalse = self.onfalse.compile(in_tail_pos, scope)
         ontrue.append((Symbol('jump'), len(onfalse) + 1))
         test.append((Symbol('jumpiffalse'), len(ontrue) + 1))
         bc += test
         bc += ontrue
         bc += onfalse
         return bc
-class Invoke:
+    def defines(self):
+        return self.test.defines() + self.ontrue.defines() + self.onfalse.defines()
+    def children(self):
+        return [self.test, self.ontrue, self.onfalse]
+class Invoke(Node):
     def __init__(self, exprs):
         self.exprs = exprs
-    def compile(self, in_tail_pos):
+        # set by mark_record_access for calls to record accessors
+        self.record_access = None
+    def inline(self, scope):
+        # the record instruction a call to an accessor or modifier stands
+        # for, unless a local shadows its name
+        if self.record_access is None:
+            return None
+        if scope is not None and scope.binds(self.exprs[0].value):
+            return None
+        descriptor, index, modifies = self.record_access
+        if modifies:
+            return RecordSet(Global(descriptor), index, self.exprs[1], self.exprs[2])
+        return RecordRef(Global(descriptor), index, self.exprs[1])
+    def escapes_only(self, scope=None):
+        # (call/cc (lambda (k) body)) of the global call/cc where body only
+        # ever calls k and cannot capture a continuation of its own, which
+        # could come back into body after the call returned. then k cannot
+        # outlive the call and call/ec does the same
+        if len(self.exprs) != 2 or not isinstance(self.exprs[0], Symbol):
+            return False
+        fn = self.exprs[1]
+        if self.exprs[0].value not in CAPTURES_CONTINUATION or not isinstance(fn, Lambda) or len(fn.params) != 1:
+            return False
+        if scope is not None and scope.binds(self.exprs[0].value):
+            return False
+        k = fn.params[0].value
+        bound = set(fn.variables()) - {k}
+        shadowed = lambda name: name in bound or (scope is not None and scope.binds(name))
+        return k not in fn.expr.defines() and k not in fn.expr.assignments() \
+            and only_called(fn.expr, k) and not may_capture(fn.expr, k, shadowed)
+    def operands(self, scope=None):
+        if self.escapes_only(scope):
+            return [Symbol(ESCAPE_CONTINUATION)] + self.exprs[1:]
+        return self.exprs
+    def compile(self, in_tail_pos, scope=None):
+        inline = self.inline(scope)
+        if inline is not None:
+            return inline.compile(in_tail_pos, scope)
         bc = []
-        for expr in self.exprs:
-            bc += expr.compile(False)
+        for expr in self.operands(scope):
+            bc += expr.compile(False, scope)
         if in_tail_pos:
             bc.append((Symbol('invoketail'), len(self.exprs)))
         else:
             bc.append((Symbol('invoke'), len(self.exprs)))
         return bc
+    def defines(self):
+        return [d for expr in self.exprs for d in expr.defines()]
+    def children(self):
+        # the call/cc is kept here, it may be a local that is captured
+        return self.exprs
+    def continuation_references(self):
+        # a call that may become call/ec does not capture. if call/cc turns
+        # out to be a local the hint is only missed, the vm still promotes
+        if self.escapes_only():
+            return set().union(*[e.continuation_references() for e in self.exprs[1:]])
+        return super().continuation_references()
+
+class MakeRecord(Node):
+    def __init__(self, descriptor, exprs):
+        self.descriptor = descriptor
+        self.exprs = exprs
+    def compile(self, _in_tail_pos, scope=None):
+        bc = self.descriptor.compile(False, scope)
+        for expr in self.exprs:
+            bc += expr.compile(False, scope)
+        bc.append((Symbol('makerecord'), len(self.exprs)))
+        return bc
+    def defines(self):
+        return []
+    def children(self):
+        return [self.descriptor] + self.exprs
+class RecordRef(Node):
+    def __init__(self, descriptor, index, record):
+        self.descriptor = descriptor
+        self.index = index
+        self.record = record
+    def compile(self, _in_tail_pos, scope=None):
+        bc = self.record.compile(False, scope)
+        bc += self.descriptor.compile(False, scope)
+        bc.append((Symbol('recordref'), self.index))
+        return bc
+    def defines(self):
+        return []
+    def children(self):
+        return [self.descriptor, self.record]
+class RecordSet(Node):
+    def __init__(self, descriptor, index, record, expr):
+        self.descriptor = descriptor
+        self.index = index
+        self.record = record
+        self.expr = expr
+    def compile(self, _in_tail_pos, scope=None):
+        bc = self.record.compile(False, scope)
+        bc += self.descriptor.compile(False, scope)
+        bc += self.expr.compile(False, scope)
+        bc.append((Symbol('recordset'), self.index))
+        return bc
+    def defines(self):
+        return []
+    def children(self):
+        return [self.descriptor, self.record, self.expr]
+class DefineRecordType(Node):
+    """
+    (define-record-type name (constructor arg ...) predicate
+        (field accessor [modifier]) ...)
+
+    Expands into defines of the descriptor and of lambdas around the record
+    instructions, so every field access is a single descriptor check.
+    Fields the constructor does not take start out as #f.
+
+    A call to an accessor or modifier of a record type defined at the top
+    level of the program is compiled to the record instruction itself,
+    without calling the lambda, where its name is not shadowed and nothing
+    else defines or assigns it. The lambdas are left for first-class use.
+    """
+    def __init__(self, name, constructor, predicate, fields):
+        self.name = name
+        self.constructor = constructor
+        self.predicate = predicate
+        self.fields = fields
+    def expand(self):
+        names = [field[0] for field in self.fields]
+        ctor, args = self.constructor
+        values = [Symbol(n.value) if n.value in [a.value for a in args] else Literal(False) for n in names]
+        record = Symbol('record')
+        value = Symbol('value')
+        exprs = [
+            Define(self.name, Invoke([Symbol('make-record-type'), Literal(Symbol(self.name.value)), Literal(names)])),
+            Define(ctor, Lambda(args, MakeRecord(self.name, values))),
+            Define(self.predicate, Lambda([record], Invoke([Symbol('record?'), record, self.name]))),
+        ]
+        for index, field in enumerate(self.fields):
+            exprs.append(Define(field[1], Lambda([record], RecordRef(self.name, index, record))))
+            if len(field) > 2:
+                exprs.append(Define(field[2], Lambda([record, value], RecordSet(self.name, index, record, value))))
+        return Sequence(exprs)
+    def compile(self, in_tail_pos, scope=None):
+        return self.expand().compile(in_tail_pos, scope)
+    def defines(self):
+        return self.expand().defines()
+    def children(self):
+        return [self.expand()]
+    def references(self):
+        return self.expand().references()
+    def assignments(self):
+        return self.expand().assignments()
+class Reset(Node):
+    """
+    (reset expr) runs expr under a continuation prompt, tagged with the
+    symbol tag so shifts for other tags pass through it.
+    """
+    def __init__(self, expr, tag=None):
+        self.expr = expr
+        self.tag = tag if tag is not None else Symbol(DEFAULT_PROMPT_TAG)
+    def expand(self):
+        return Invoke([Symbol('call-with-continuation-prompt'), Lambda([], self.expr), Literal(self.tag)])
+    def compile(self, in_tail_pos, scope=None):
+        return self.expand().compile(in_tail_pos, scope)
+    def defines(self):
+        return []
+    def children(self):
+        return [self.expand()]
+class Shift(Node):
+    """
+    (shift k expr) removes the continuation up to the nearest reset with
+    the same tag and runs expr in its place with k bound to it.
+    """
+    def __init__(self, symbol, expr, tag=None):
+        self.symbol = symbol
+        self.expr = expr
+        self.tag = tag if tag is not None else Symbol(DEFAULT_PROMPT_TAG)
+    def expand(self):
+        return Invoke([Symbol('call-with-delimited-continuation'), Lambda([self.symbol], self.expr), Literal(self.tag)])
+    def compile(self, in_tail_pos, scope=None):
+        return self.expand().compile(in_tail_pos, scope)
+    def defines(self):
+        return []
+    def children(self):
+        return [self.expand()]
 
 class SourceTransform:
     def __init__(self, source, lines, variable):
@@ -0,0 +1,112 @@
+#include "assembler.hh"
+
+Handle Assembler::Assemble(Heap* heap, SymbolTable* symbols, Handle instructions) {
+    std::int64_t count = instructions.AsVector()->Length().Value();
+
+    // byte offset of every instruction and of the end, to turn jump offsets
+    // counted in instructions into offsets counted in bytes
+    std::vector<std::size_t> offsets(count + 1, 0);
+    for (std::int64_t i = 0; i < count; i++) {
+        Pair* instruction = instructions.AsVector()->GetItem(Integer(i)).AsReference()->Value()->AsPair();
+        std::uint64_t opcode = instruction->First().AsSymbol()->Value();
+        if (!WellKnownSymbols::IsOpcode(opcode) || WellKnownSymbols::IsQuickened(opcode)) {
+            std::stringstream stream;
+            stream << "Unknown bytecode: " << symbols->ToString(Symbol(opcode));
+            throw std::runtime_error{stream.str()};
+        }
+        offsets[i + 1] = offsets[i] + Code::InstructionSize(opcode);
+    }
+
+    std::vector<std::uint8_t> bytes;
+    bytes.reserve(offsets[count] + Code::InstructionSize(WellKnownSymbols::opcode_halt));
+    std::vector<Handle> constants;
+
+    for (std::int64_t i = 0; i < count; i++) {
+        Handle instruction = heap->GetHandle(instructions.AsVector()->GetItem(Integer(i)));
+        Symbol opcode = *instruction.AsPair()->First().AsSymbol();
+        std::string_view format = WellKnownSymbols::OPERANDS[opcode.Value()];
+
+        bytes.push_back(static_cast<std::uint8_t>(opcode.Value()));
+
+        Handle rest = heap->GetHandle(instruction.AsPair()->Second());
+        for (char kind : format) {
+            if (kind == 's') {
+                encodeOperand(bytes, constants.size());
+                constants.push_back(heap->GetHandle(Nil()));
+                continue;
+            }
+            if (rest.Data().GetType() == Primitive::Type::Nil) {
+                throwMalformed(symbols, opcode, "is missing operands");
+            }
+            Handle operand = heap->GetHandle(rest.AsPair()->First());
+            rest = heap->GetHandle(rest.AsPair()->Second());
+
+            switch (kind) {
+                case 'k': {
+                    encodeOperand(bytes, constants.size());
+                    constants.push_back(operand);
+                    break;
+                }
+                case 'c': {
+                    encodeOperand(bytes, constants.size());
+                    constants.push_back(Assemble(heap, symbols, operand));
+                    break;
+                }
+                case 'i': {
+                    encodeOperand(bytes, integerOperand(operand.Data()));
+                    break;
+                }
+                case 'j': {
+                    std::int64_t target = i + integerOperand(operand.Data());
+                    if (target < 0 || target > count) {
+                        throwMalformed(symbols, opcode, "jumps out of its code");
+                    }
+                    encodeOperand(bytes, offsets[target] - offsets[i + 1]);
+                    break;
+                }
+                case 'b': {
+                    encodeOperand(bytes, operand.Data().AsBoolean()->Value() ? 1 : 0);
+                    break;
+                }
+                default: throw std::runtime_error{"Unknown operand format"};
+            }
+        }
+
+        if (rest.Data().GetType() != Primitive::Type::Nil) {
+            throwMalformed(symbols, opcode, "has too many operands");
+        }
+    }
+
+    // running off the end of the code stops the whole execution
+    bytes.push_back(WellKnownSymbols::opcode_halt);
+
+    Handle pool = heap->NewVector(constants.size());
+    for (std::size_t i = 0; i < constants.size(); i++) {
+        pool.AsVector()->SetItem(Integer(i), constants[i].Data());
+    }
+
+    DEBUGLN("Assembled " << count << " instructions into " << bytes.size() << " bytes and " << constants.size() << " constants");
+
+    return heap->NewCode(bytes, pool);
+}
+
+void Assembler::encodeOperand(std::vector<std::uint8_t>& bytes, std::int64_t value) {
+    std::uint32_t encoded = static_cast<std::uint32_t>(static_cast<std::int32_t>(value));
+    std::uint8_t buffer[Code::OPERAND_SIZE];
+    std::memcpy(buffer, &encoded, Code::OPERAND_SIZE);
+    bytes.insert(bytes.end(), buffer, buffer + Code::OPERAND_SIZE);
+}
+
+std::int64_t Assembler::integerOperand(Primitive operand) {
+    std::int64_t value = operand.AsInteger()->Value();
+    if (value < std::numeric_limits<std::int32_t>::min() || value > std::numeric_limits<std::int32_t>::max()) {
+        throw std::runtime_error{"Integer operand does not fit in an instruction"};
+    }
+    return value;
+}
+
+void Assembler::throwMalformed(SymbolTable* symbols, Symbol opcode, const char* reason) {
+    std::stringstream stream;
+    stream << "Instruction " << symbols->ToString(opcode) << " " << reason;
+    throw std::runtime_error{stream.str()};
+}
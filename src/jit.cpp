@@ -0,0 +1,242 @@
+#include "jit.hh"
+
+#if FLANG_JIT
+
+#include <sys/mman.h>
+
+namespace {
+
+// appends x86-64 instructions, jumps to instructions that were not
+// emitted yet are patched once every instruction has an address
+class Emitter {
+public:
+    std::vector<std::uint8_t> bytes;
+
+    void Byte(std::uint8_t value) {
+        bytes.push_back(value);
+    }
+
+    void Bytes(std::initializer_list<std::uint8_t> values) {
+        bytes.insert(bytes.end(), values);
+    }
+
+    void Imm32(std::int32_t value) {
+        std::uint8_t buffer[sizeof(value)];
+        std::memcpy(buffer, &value, sizeof(value));
+        bytes.insert(bytes.end(), buffer, buffer + sizeof(value));
+    }
+
+    void Imm64(std::uint64_t value) {
+        std::uint8_t buffer[sizeof(value)];
+        std::memcpy(buffer, &value, sizeof(value));
+        bytes.insert(bytes.end(), buffer, buffer + sizeof(value));
+    }
+
+    // leaves room for a rel32 to the code of the instruction at pc
+    void JumpTo(std::size_t pc) {
+        fixups.push_back(Fixup{bytes.size(), pc});
+        Imm32(0);
+    }
+
+    // leaves room for a rel32 to an exit
+    void ExitTo(std::vector<std::size_t>& exit) {
+        exit.push_back(bytes.size());
+        Imm32(0);
+    }
+
+    void Patch(std::size_t at, std::size_t target) {
+        std::int32_t relative = static_cast<std::int32_t>(target - (at + sizeof(std::int32_t)));
+        std::memcpy(&bytes[at], &relative, sizeof(relative));
+    }
+
+    void PatchJumps(const std::vector<std::size_t>& labels) {
+        for (const Fixup& fixup : fixups) {
+            Patch(fixup.at, labels.at(fixup.pc));
+        }
+    }
+
+private:
+    struct Fixup {
+        std::size_t at;
+        std::size_t pc;
+    };
+
+    std::vector<Fixup> fixups;
+};
+
+}
+
+/*
+    Registers while the code runs
+        rbx - the vm
+        r12 - the interpreter registers
+
+    Neither is touched by the handlers, which are plain calls, and no heap
+    pointer is ever kept in a machine register, so a collection during a
+    handler has nothing to fix up.
+*/
+JitCode::JitCode(Code* code, const Handler* _handlers, std::size_t pc_offset, std::size_t native_offset)
+: handlers{_handlers}
+{
+    std::size_t length = code->Length().Value();
+    std::uint8_t pc_disp = static_cast<std::uint8_t>(pc_offset);
+    std::uint8_t native_disp = static_cast<std::uint8_t>(native_offset);
+
+    std::size_t count = 0;
+    for (std::size_t pc = 0; pc < length; pc += Code::InstructionSize(code->OpcodeAt(pc))) {
+        count += 1;
+    }
+    // handlers and the code keep pointers into these, so they must never
+    // grow again
+    instructions.reserve(count);
+    offsets.reserve(count);
+    sites.reserve(count);
+
+    Emitter e;
+    std::vector<std::size_t> labels(length + 1, 0);
+    std::vector<std::size_t> stops;
+    std::vector<std::size_t> leaves;
+    std::vector<std::size_t> dispatches;
+
+    // push rbx; push r12; sub rsp, 8 to keep the calls aligned
+    e.Bytes({0x53, 0x41, 0x54, 0x48, 0x83, 0xec, 0x08});
+    // mov rbx, rdi; mov r12, rsi
+    e.Bytes({0x48, 0x89, 0xfb, 0x49, 0x89, 0xf4});
+    // mov rax, [r12 + pc]
+    std::size_t dispatch = e.bytes.size();
+    e.Bytes({0x49, 0x8b, 0x44, 0x24, pc_disp});
+    // mov rcx, targets; jmp [rcx + rax * 8]
+    e.Bytes({0x48, 0xb9});
+    std::size_t table = e.bytes.size();
+    e.Imm64(0);
+    e.Bytes({0xff, 0x24, 0xc1});
+
+    for (std::size_t pc = 0; pc < length; ) {
+        instructions.push_back(code->Decode(pc));
+        offsets.push_back(pc);
+        sites.push_back(handlers[instructions.back().opcode]);
+        const Code::Instruction& ins = instructions.back();
+        std::size_t next = pc + Code::InstructionSize(ins.opcode);
+        labels[pc] = e.bytes.size();
+
+        if (ins.opcode == WellKnownSymbols::opcode_jump) {
+            // jmp target
+            e.Byte(0xe9);
+            e.JumpTo(next + static_cast<std::int32_t>(ins.operands[0]));
+            pc = next;
+            continue;
+        }
+
+        // mov qword [r12 + pc], next
+        e.Bytes({0x49, 0xc7, 0x44, 0x24, pc_disp});
+        e.Imm32(static_cast<std::int32_t>(next));
+        // mov rdi, rbx; mov rsi, r12
+        e.Bytes({0x48, 0x89, 0xdf, 0x4c, 0x89, 0xe6});
+        // mov rdx, ins; mov rax, site; call [rax]
+        e.Bytes({0x48, 0xba});
+        e.Imm64(reinterpret_cast<std::uint64_t>(&ins));
+        e.Bytes({0x48, 0xb8});
+        e.Imm64(reinterpret_cast<std::uint64_t>(&sites.back()));
+        e.Bytes({0xff, 0x10});
+        // test eax, eax; jz stop
+        e.Bytes({0x85, 0xc0, 0x0f, 0x84});
+        e.ExitTo(stops);
+
+        // an instruction and its quickened variants agree on this, so it
+        // still holds once the instruction is rewritten
+        if (WellKnownSymbols::TransfersControl(ins.opcode)) {
+            // cmp eax, LEAVE; jne next
+            e.Bytes({0x83, 0xf8, LEAVE, 0x75, 0x1d});
+            // the frame that took over may run this same code, as
+            // calls to itself do, then there is no need to leave.
+            // mov rax, [r12 + native]; mov rcx, this; cmp rax, rcx
+            e.Bytes({0x49, 0x8b, 0x44, 0x24, native_disp, 0x48, 0xb9});
+            e.Imm64(reinterpret_cast<std::uint64_t>(this));
+            e.Bytes({0x48, 0x39, 0xc8});
+            // jne leave; jmp dispatch
+            e.Bytes({0x0f, 0x85});
+            e.ExitTo(leaves);
+            e.Byte(0xe9);
+            e.ExitTo(dispatches);
+        } else if (ins.opcode == WellKnownSymbols::opcode_jumpiffalse) {
+            // the handler moved the program counter if it jumped,
+            // cmp qword [r12 + pc], target; je target
+            std::size_t target = next + static_cast<std::int32_t>(ins.operands[0]);
+            e.Bytes({0x49, 0x81, 0x7c, 0x24, pc_disp});
+            e.Imm32(static_cast<std::int32_t>(target));
+            e.Bytes({0x0f, 0x84});
+            e.JumpTo(target);
+        }
+
+        pc = next;
+    }
+    // code always ends with a halt, so nothing falls through to here
+    labels[length] = e.bytes.size();
+
+    // add rsp, 8; pop r12; pop rbx; ret
+    const std::initializer_list<std::uint8_t> epilogue = {0x48, 0x83, 0xc4, 0x08, 0x41, 0x5c, 0x5b, 0xc3};
+
+    std::size_t stop = e.bytes.size();
+    // xor eax, eax
+    e.Bytes({0x31, 0xc0});
+    e.Bytes(epilogue);
+
+    std::size_t leave = e.bytes.size();
+    // mov eax, LEAVE
+    e.Byte(0xb8);
+    e.Imm32(LEAVE);
+    e.Bytes(epilogue);
+
+    for (std::size_t at : stops) {
+        e.Patch(at, stop);
+    }
+    for (std::size_t at : leaves) {
+        e.Patch(at, leave);
+    }
+    for (std::size_t at : dispatches) {
+        e.Patch(at, dispatch);
+    }
+    e.PatchJumps(labels);
+
+    size = e.bytes.size();
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        memory = nullptr;
+        throw std::runtime_error{"Could not map memory for machine code"};
+    }
+
+    std::uint8_t* base = static_cast<std::uint8_t*>(memory);
+    targets.assign(length + 1, nullptr);
+    for (std::size_t pc = 0, i = 0; i < instructions.size(); pc += Code::InstructionSize(instructions[i].opcode), i++) {
+        targets[pc] = base + labels[pc];
+    }
+    std::uint64_t table_address = reinterpret_cast<std::uint64_t>(targets.data());
+    std::memcpy(&e.bytes[table], &table_address, sizeof(table_address));
+
+    std::memcpy(memory, e.bytes.data(), size);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        memory = nullptr;
+        throw std::runtime_error{"Could not make machine code executable"};
+    }
+    entry = reinterpret_cast<Entry>(memory);
+
+    DEBUGLN("Compiled " << instructions.size() << " instructions into " << size << " bytes of machine code");
+}
+
+void JitCode::Rewrite(std::size_t pc, std::uint8_t opcode) {
+    std::size_t index = std::lower_bound(offsets.begin(), offsets.end(), pc) - offsets.begin();
+    if (index == offsets.size() || offsets[index] != pc) {
+        throw std::runtime_error{"Rewrite of an instruction the machine code does not have"};
+    }
+    instructions[index].opcode = opcode;
+    sites[index] = handlers[opcode];
+}
+
+JitCode::~JitCode() {
+    if (memory != nullptr) {
+        munmap(memory, size);
+    }
+}
+
+#endif // FLANG_JIT
@@ -25,12 +25,11 @@ void print(Primitive p) {
             std::cout << "]";
         }
         void OnString(const String* casted) override {
-            std::cout << "\"";
-            std::size_t n = casted->Length().Value();
-            for (std::size_t i = 0; i < n; i++) {
-                std::cout << casted->GetChar(Integer(i)).Value();
-            }
-            std::cout << "\"";
+            std::cout << "\"" << casted->ToStdString() << "\"";
+        }
+        void OnRope(const Rope* obj) override {
+            Primitive ref = Reference(const_cast<Rope*>(obj));
+            std::cout << "\"" << Rope::ToStdString(ref) << "\"";
         }
         void OnMap(const Map* obj) override { std::cout << "todo"; }
         void OnEnvrionment(const Envrionment* obj) override { std::cout << "todo"; }
@@ -39,6 +38,78 @@ void print(Primitive p) {
         void OnNativeFunction(const NativeFunction* obj) override { std::cout << "todo"; }
         void OnLambda(const Lambda* obj) override { std::cout << "todo"; }
         void OnContinuation(const Continuation* obj) override { std::cout << "todo"; }
+        void OnEscapeContinuation(const EscapeContinuation* obj) override { std::cout << "escape continuation"; }
+        void OnPrompt(const Prompt* obj) override {
+            std::cout << "prompt (";
+            print(obj->ConstTag());
+            std::cout << ")";
+        }
+        void OnCell(const Cell* obj) override {
+            std::cout << "cell (";
+            print(obj->ConstValue());
+            std::cout << ")";
+        }
+        void OnEqHashtable(const EqHashtable* obj) override { std::cout << "todo"; }
+        void OnPersistentMap(const PersistentMap* obj) override {
+            bool first = true;
+            std::cout << "{";
+            PersistentMap::ForEach(const_cast<PersistentMap*>(obj), [&first](Primitive key, Primitive value) {
+                if (!first) {
+                    std::cout << ", ";
+                }
+                first = false;
+                print(key);
+                std::cout << " ";
+                print(value);
+            });
+            std::cout << "}";
+        }
+        void OnPersistentVector(const PersistentVector* obj) override {
+            PersistentVector* v = const_cast<PersistentVector*>(obj);
+            std::cout << "[";
+            for (std::int64_t i = 0; i < v->Length().Value(); i++) {
+                if (i != 0) {
+                    std::cout << ", ";
+                }
+                print(PersistentVector::Get(v, Integer(i)));
+            }
+            std::cout << "]";
+        }
+        void OnRecordType(const RecordType* obj) override {
+            std::cout << "record-type (";
+            print(obj->ConstName());
+            std::cout << ")";
+        }
+        void OnRecord(const Record* obj) override {
+            std::cout << "record (";
+            for (std::int64_t i = 0; i < obj->FieldCount().Value(); i++) {
+                if (i != 0) {
+                    std::cout << ", ";
+                }
+                print(obj->GetField(Integer(i)));
+            }
+            std::cout << ")";
+        }
+        void OnGrowableVector(const GrowableVector* obj) override {
+            GrowableVector* v = const_cast<GrowableVector*>(obj);
+            std::cout << "[";
+            for (std::int64_t i = 0; i < v->Length().Value(); i++) {
+                if (i != 0) {
+                    std::cout << ", ";
+                }
+                print(GrowableVector::Get(v, Integer(i)));
+            }
+            std::cout << "]";
+        }
+        void OnStringBuilder(const StringBuilder* obj) override { std::cout << "todo"; }
+        void OnCode(const Code* obj) override {
+            std::cout << "code (" << obj->Length().Value() << " bytes)";
+        }
+        void OnBox(const Box* obj) override {
+            std::cout << "box (";
+            print(obj->ConstValue());
+            std::cout << ")";
+        }
     } obj_visitor;
 
     struct PrimVisitor : Primitive::Visitor {
@@ -66,7 +137,9 @@ void print(Primitive p) {
             std::cout << "boolean " << (obj->Value() ? "true" : "false");
         }
         void OnCharacter(const Character* obj) override {
-            std::cout << "char " << obj->Value();
+            std::string encoded;
+            Utf8Encode(obj->Value(), encoded);
+            std::cout << "char " << encoded;
         }
         void OnNativeReference(const NativeReference* obj) override {
             std::cout << "native " << obj->Value();
@@ -0,0 +1,6 @@
+#include "objects/box.hh"
+#include "heap.hh"
+
+Box::Box(Handle _value) : Structure() {
+    Value() = _value;
+}
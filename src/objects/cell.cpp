@@ -0,0 +1,7 @@
+#include "objects/cell.hh"
+#include "heap.hh"
+
+Cell::Cell(Handle _name) : Structure() {
+    Name() = _name;
+    Bound() = Boolean(false);
+}
@@ -0,0 +1,12 @@
+#include "objects/code.hh"
+#include "heap.hh"
+
+Code::Code(const std::vector<std::uint8_t>& _bytes, Handle constants)
+: Object(Object::Type::Code, AllocationSize(_bytes.size()))
+{
+    *slot(0) = constants;
+    *slot(1) = Integer(_bytes.size());
+    header()->calls = 0;
+    header()->native = nullptr;
+    std::memcpy(bytes(), _bytes.data(), _bytes.size());
+}
@@ -0,0 +1,7 @@
+#include "objects/continuation.hh"
+#include "heap.hh"
+
+Continuation::Continuation(Handle _frame, Handle _prompt) : Structure() {
+    Frame() = _frame;
+    Prompt() = _prompt;
+}
@@ -1,26 +1,61 @@
 #include "objects/env.hh"
+#include "heap.hh"
 
-/*
-    static Primitive Lookup(Envrionment* self, Primitive symbol) {
-        if (symbol.GetType() != Primitive::Type::Symbol) {
-            throw std::runtime_error{"Variable lookup must be a symbol"};
-        }
-        Primitive env = Primitive::Reference(self);
-        while (env.GetType() != Primitive::Type::Nil) {
-            Envrionment* e = env.GetReference()->AsEnvrionment();
-            Primitive result = Map::Lookup(e->lookup(), symbol);
-            if (result.GetType() != Primitive::Type::Nil) {
-                return result;
+Envrionment::Envrionment(Handle _outer, Handle _lookup, Handle _slots) : Structure() {
+    Outer() = _outer;
+    Lookup() = _lookup;
+    Slots() = _slots;
+}
+
+Primitive* Envrionment::Lookup(Envrionment* self, Symbol symbol) {
+    Envrionment* env = self;
+    while (env != nullptr) {
+        if (env->Lookup().GetType() != Primitive::Type::Nil) {
+            Primitive* result = Map::Find(env->Lookup().AsReference()->Value()->AsMap(), symbol);
+            if (result != nullptr) {
+                Cell* cell = result->AsReference()->Value()->AsCell();
+                return cell->IsBound() ? &cell->Value() : nullptr;
             }
-            env = e->outer();
         }
-        return Primitive::Nil();
+        Primitive outer = env->Outer();
+        if (outer.GetType() == Primitive::Type::Nil) {
+            break;
+        }
+        env = outer.AsReference()->Value()->AsEnvrionment();
     }
+    return nullptr;
+}
+
+void Envrionment::Define(Heap* heap, Handle self, Symbol symbol, Handle value) {
+    Handle cell = Intern(heap, self, symbol);
+    // redefinition updates the existing cell, so linked code sees it
+    cell.AsCell()->Value() = value;
+    cell.AsCell()->Bound() = Boolean(true);
+}
+
+Handle Envrionment::Intern(Heap* heap, Handle self, Symbol symbol) {
+    if (self.AsEnvrionment()->Lookup().GetType() == Primitive::Type::Nil) {
+        Handle lookup = heap->NewMap();
+        self.AsEnvrionment()->Lookup() = lookup;
+    }
+
+    Map* map = self.AsEnvrionment()->Lookup().AsReference()->Value()->AsMap();
+    Primitive* existing = Map::Find(map, symbol);
+    if (existing != nullptr) {
+        return heap->GetHandle(*existing);
+    }
+
+    Handle name = heap->GetHandle(symbol);
+    Handle cell = heap->NewCell(name);
+    Handle lookup = heap->GetHandle(self.AsEnvrionment()->Lookup());
+    Map::Insert(heap, lookup, name, cell);
+    return cell;
+}
 
-void Envrionment::Define(Envrionment* self, Heap* heap, Primitive symbol, Primitive value) {
-    if (symbol.GetType() != Primitive::Type::Symbol) {
-        throw std::runtime_error{"Variable definition must be a symbol"};
+Envrionment* Envrionment::Resolve(Envrionment* self, std::int64_t depth) {
+    Envrionment* env = self;
+    for (std::int64_t i = 0; i < depth; i++) {
+        env = env->Outer().AsReference()->Value()->AsEnvrionment();
     }
-    Map::Insert(self->lookup(), heap, symbol, value);
+    return env;
 }
-*/
\ No newline at end of file
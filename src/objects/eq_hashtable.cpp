@@ -0,0 +1,36 @@
+#include "objects/eq_hashtable.hh"
+#include "objects/equality.hh"
+#include "objects/open_addressing.hh"
+
+EqHashtable::EqHashtable() : Structure() {
+    Count() = Integer(0);
+}
+
+std::uint64_t EqHashtable::Hash(Primitive key) {
+    switch (key.GetType()) {
+        case Primitive::Type::Nil: {
+            throw std::runtime_error{"Nil cannot be used as a hashtable key"};
+        }
+        case Primitive::Type::Reference: {
+            return Equality::Mix(key.AsReference()->Value()->IdentityHash());
+        }
+        default: break;
+    }
+    return Equality::Mix(key.Bits());
+}
+
+bool EqHashtable::KeyEquals(Primitive k1, Primitive k2) {
+    return k1.Bits() == k2.Bits();
+}
+
+Primitive* EqHashtable::Find(EqHashtable* self, Primitive key) {
+    return OpenAddressing<EqHashtable>::Find(self, key);
+}
+
+void EqHashtable::Insert(Heap* heap, Handle self, Handle key, Handle value) {
+    OpenAddressing<EqHashtable>::Insert(heap, self, key, value);
+}
+
+bool EqHashtable::Remove(EqHashtable* self, Primitive key) {
+    return OpenAddressing<EqHashtable>::Remove(self, key);
+}
@@ -0,0 +1,215 @@
+#include "objects/equality.hh"
+#include "objects/pair.hh"
+#include "objects/real.hh"
+#include "objects/rope.hh"
+#include "objects/string.hh"
+#include "objects/vector.hh"
+
+static Object* asObject(Primitive value) {
+    return value.AsReference()->Value();
+}
+
+// compares the text of two strings or ropes piece by piece, nothing is
+// copied and nothing allocates
+static bool sameText(Primitive a, Primitive b) {
+    Rope::Leaves la{a};
+    Rope::Leaves lb{b};
+    std::string_view pa;
+    std::string_view pb;
+    for (;;) {
+        if (pa.empty()) {
+            pa = la.Next();
+        }
+        if (pb.empty()) {
+            pb = lb.Next();
+        }
+        if (pa.empty() || pb.empty()) {
+            return pa.empty() && pb.empty();
+        }
+        std::size_t n = std::min(pa.size(), pb.size());
+        if (pa.substr(0, n) != pb.substr(0, n)) {
+            return false;
+        }
+        pa.remove_prefix(n);
+        pb.remove_prefix(n);
+    }
+}
+
+static std::uint32_t textHash(Primitive str) {
+    Object* obj = asObject(str);
+    return obj->IsString() ? obj->AsString()->Hash() : obj->AsRope()->Hash();
+}
+
+bool Equality::Equal(Primitive a, Primitive b) {
+    // immediates are answered without setting up the traversal
+    if (a.Bits() == b.Bits()) {
+        return true;
+    }
+    if (a.GetType() != Primitive::Type::Reference || b.GetType() != Primitive::Type::Reference) {
+        return a.GetType() == Primitive::Type::Real
+            && b.GetType() == Primitive::Type::Real
+            && a.AsReal()->Value() == b.AsReal()->Value();
+    }
+
+    bool exhausted = false;
+    bool result = compare(a, b, nullptr, &exhausted);
+    if (!exhausted) {
+        return result;
+    }
+    DEBUGLN("equal? budget exhausted, comparing with cycle detection");
+    Assumed assumed;
+    return compare(a, b, &assumed, &exhausted);
+}
+
+bool Equality::isStringLike(Primitive value) {
+    if (value.GetType() != Primitive::Type::Reference) {
+        return false;
+    }
+    Object* obj = asObject(value);
+    return obj->IsString() || obj->IsRope();
+}
+
+bool Equality::compare(Primitive a, Primitive b, Assumed* assumed, bool* exhausted) {
+    std::vector<std::pair<Primitive, Primitive>> work;
+    work.emplace_back(a, b);
+    std::size_t budget = FAST_BUDGET;
+
+    while (!work.empty()) {
+        auto [x, y] = work.back();
+        work.pop_back();
+
+        if (x.Bits() == y.Bits()) {
+            continue;
+        }
+
+        if (x.GetType() != y.GetType()) {
+            return false;
+        }
+
+        if (x.GetType() == Primitive::Type::Real) {
+            if (x.AsReal()->Value() != y.AsReal()->Value()) {
+                return false;
+            }
+            continue;
+        }
+
+        if (x.GetType() != Primitive::Type::Reference) {
+            return false;
+        }
+
+        if (isStringLike(x) && isStringLike(y)) {
+            Object* ox = asObject(x);
+            Object* oy = asObject(y);
+            if (ox->IsString() && oy->IsString()) {
+                String* sx = ox->AsString();
+                String* sy = oy->AsString();
+                if (sx->ByteLength().Value() != sy->ByteLength().Value() || sx->Hash() != sy->Hash()) {
+                    return false;
+                }
+            } else if (Rope::LengthOf(x).Value() != Rope::LengthOf(y).Value() || textHash(x) != textHash(y)) {
+                return false;
+            }
+            if (!sameText(x, y)) {
+                return false;
+            }
+            continue;
+        }
+
+        Object* ox = asObject(x);
+        Object* oy = asObject(y);
+
+        bool compound = (ox->IsPair() && oy->IsPair()) || (ox->IsVector() && oy->IsVector());
+        if (!compound) {
+            // everything else is only equal to itself
+            return false;
+        }
+
+        if (assumed == nullptr) {
+            if (budget == 0) {
+                *exhausted = true;
+                return false;
+            }
+            budget -= 1;
+        } else if (!assumed->emplace(ox, oy).second) {
+            // already being compared further up, assume it is equal
+            continue;
+        }
+
+        if (ox->IsPair()) {
+            work.emplace_back(ox->AsPair()->Second(), oy->AsPair()->Second());
+            work.emplace_back(ox->AsPair()->First(), oy->AsPair()->First());
+            continue;
+        }
+
+        Vector* vx = ox->AsVector();
+        Vector* vy = oy->AsVector();
+        std::int64_t length = vx->Length().Value();
+        if (length != vy->Length().Value()) {
+            return false;
+        }
+        for (std::int64_t i = length - 1; i >= 0; i--) {
+            work.emplace_back(vx->GetItem(Integer(i)), vy->GetItem(Integer(i)));
+        }
+    }
+
+    return true;
+}
+
+std::uint64_t Equality::immediateHash(Primitive value) {
+    if (value.GetType() == Primitive::Type::Real) {
+        // hashes the value rather than the bits, 0.0 and -0.0 are equal
+        float real = value.AsReal()->Value();
+        if (real == 0.0f) {
+            real = 0.0f;
+        }
+        std::uint32_t bits = 0;
+        std::memcpy(&bits, &real, sizeof(bits));
+        return Mix(bits);
+    }
+    return Mix(value.Bits());
+}
+
+std::uint64_t Equality::Hash(Primitive value) {
+    if (value.GetType() != Primitive::Type::Reference) {
+        return immediateHash(value);
+    }
+
+    std::vector<Primitive> work;
+    work.push_back(value);
+    std::uint64_t hash = 0;
+    std::size_t visited = 0;
+
+    while (!work.empty() && visited < HASH_BUDGET) {
+        Primitive current = work.back();
+        work.pop_back();
+        visited += 1;
+
+        std::uint64_t h = 0;
+        if (current.GetType() != Primitive::Type::Reference) {
+            h = immediateHash(current);
+        } else if (isStringLike(current)) {
+            h = Mix(textHash(current));
+        } else if (asObject(current)->IsPair()) {
+            Pair* pair = asObject(current)->AsPair();
+            h = Mix(static_cast<std::uint64_t>(Object::Type::Pair));
+            work.push_back(pair->Second());
+            work.push_back(pair->First());
+        } else if (asObject(current)->IsVector()) {
+            Vector* vector = asObject(current)->AsVector();
+            std::int64_t length = vector->Length().Value();
+            h = Mix(static_cast<std::uint64_t>(Object::Type::Vector) ^ (length << 8));
+            // items past the budget would never be popped
+            std::int64_t hashed = std::min<std::int64_t>(length, HASH_BUDGET - visited);
+            for (std::int64_t i = hashed - 1; i >= 0; i--) {
+                work.push_back(vector->GetItem(Integer(i)));
+            }
+        } else {
+            // only equal to itself, so the identity hash is consistent
+            h = Mix(asObject(current)->IdentityHash());
+        }
+
+        hash = Mix(hash ^ h) + visited;
+    }
+
+    return hash;
+}
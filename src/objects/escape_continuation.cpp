@@ -0,0 +1,6 @@
+#include "objects/escape_continuation.hh"
+#include "heap.hh"
+
+EscapeContinuation::EscapeContinuation(Handle _depth) : Structure() {
+    Depth() = _depth;
+}
@@ -0,0 +1,12 @@
+#include "objects/frame.hh"
+#include "heap.hh"
+
+Frame::Frame(Handle _bytecode, Handle _outer, Handle _temps, Handle _env, Handle _closure) : Structure() {
+    Bytecode() = _bytecode;
+    Outer() = _outer;
+    Temps() = _temps;
+    Env() = _env;
+    ProgramCounter() = Integer(0);
+    Closure() = _closure;
+    Mark() = Nil();
+}
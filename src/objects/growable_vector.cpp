@@ -0,0 +1,89 @@
+#include "objects/growable_vector.hh"
+#include "heap.hh"
+
+GrowableVector::GrowableVector() : Structure() {
+    Count() = Integer(0);
+}
+
+std::size_t GrowableVector::capacity(GrowableVector* self) {
+    if (self->Items().GetType() == Primitive::Type::Nil) {
+        return 0;
+    }
+    return self->Items().AsReference()->Value()->AsVector()->Length().Value();
+}
+
+void GrowableVector::checkIndex(GrowableVector* self, Integer index) {
+    if (index.Value() < 0 || index.Value() >= self->Length().Value()) {
+        throw std::runtime_error{"Growable vector index out of bounds"};
+    }
+}
+
+Primitive GrowableVector::Get(GrowableVector* self, Integer index) {
+    checkIndex(self, index);
+    return self->Items().AsReference()->Value()->AsVector()->GetItem(index);
+}
+
+void GrowableVector::Set(GrowableVector* self, Integer index, Primitive value) {
+    checkIndex(self, index);
+    self->Items().AsReference()->Value()->AsVector()->SetItem(index, value);
+}
+
+void GrowableVector::Push(Heap* heap, Handle self, Handle value) {
+    std::size_t count = self.AsGrowableVector()->Length().Value();
+    if (count == capacity(self.AsGrowableVector())) {
+        grow(heap, self);
+    }
+    GrowableVector* v = self.AsGrowableVector();
+    v->Items().AsReference()->Value()->AsVector()->SetItem(Integer(count), value.Data());
+    v->Count() = Integer(count + 1);
+}
+
+Handle GrowableVector::Pop(Heap* heap, Handle self) {
+    GrowableVector* v = self.AsGrowableVector();
+    std::int64_t count = v->Length().Value();
+    if (count == 0) {
+        throw std::runtime_error{"Pop from an empty growable vector"};
+    }
+    Vector* items = v->Items().AsReference()->Value()->AsVector();
+    Primitive value = items->GetItem(Integer(count - 1));
+    // drop the reference so the collector does not keep it alive
+    items->SetItem(Integer(count - 1), Nil());
+    v->Count() = Integer(count - 1);
+    return heap->GetHandle(value);
+}
+
+Handle GrowableVector::ToVector(Heap* heap, Handle self) {
+    std::size_t count = self.AsGrowableVector()->Length().Value();
+    Handle result = heap->NewVector(count);
+
+    // no allocation below here, so raw pointers stay valid
+    if (count != 0) {
+        Vector* from = self.AsGrowableVector()->Items().AsReference()->Value()->AsVector();
+        Vector* to = result.AsVector();
+        for (std::size_t i = 0; i < count; i++) {
+            to->SetItem(Integer(i), from->GetItem(Integer(i)));
+        }
+    }
+
+    return result;
+}
+
+void GrowableVector::grow(Heap* heap, Handle self) {
+    std::size_t old_capacity = capacity(self.AsGrowableVector());
+    std::size_t new_capacity = old_capacity == 0 ? INITIAL_CAPACITY : old_capacity * 2;
+
+    DEBUGLN("Growing growable vector from " << old_capacity << " to " << new_capacity);
+
+    Handle fresh = heap->NewVector(new_capacity);
+
+    // no allocation below here, so raw pointers stay valid
+    if (old_capacity != 0) {
+        Vector* from = self.AsGrowableVector()->Items().AsReference()->Value()->AsVector();
+        Vector* to = fresh.AsVector();
+        for (std::size_t i = 0; i < old_capacity; i++) {
+            to->SetItem(Integer(i), from->GetItem(Integer(i)));
+        }
+    }
+
+    self.AsGrowableVector()->Items() = fresh;
+}
@@ -0,0 +1,10 @@
+#include "objects/lambda.hh"
+#include "heap.hh"
+
+Lambda::Lambda(Handle _parameters, Handle _free, Handle _bytecode, Handle _locals, Handle _heap_locals) : Structure() {
+    Parameters() = _parameters;
+    Free() = _free;
+    Bytecode() = _bytecode;
+    Locals() = _locals;
+    HeapLocals() = _heap_locals;
+}
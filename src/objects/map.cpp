@@ -1,61 +1,35 @@
 #include "objects/map.hh"
-#include "heap.hh"
+#include "objects/equality.hh"
+#include "objects/open_addressing.hh"
 
-/*
-void Map::Insert(Map* self_, Heap* heap, Primitive key_, Primitive value_) {
-
-    ReferenceHandle<Map> self = heap->GetHandle(self_);
-    PrimitiveHandle key = heap->GetHandle(key_);
-    PrimitiveHandle value = heap->GetHandle(value_);
-
-    Pair* lookup = Map::LookupNode(self.GetPointer(), key.GetData());
+Map::Map() : Structure() {
+    Count() = Integer(0);
+}
 
-    // update
-    if (lookup != nullptr) {
-        Pair::SetSecond(lookup, value.GetData());
-        return;
+std::uint64_t Map::Hash(Primitive key) {
+    switch (key.GetType()) {
+        case Primitive::Type::Nil: {
+            throw std::runtime_error{"Nil cannot be used as a map key"};
+        }
+        default: break;
     }
 
-    // insert
-    ReferenceHandle<Pair> kvpair = heap->GetHandle(
-        heap->NewPair(key.GetData(), value.GetData())
-    );
-
-    ReferenceHandle<Pair> new_head = heap->GetHandle(
-        heap->NewPair(
-            kvpair.GetData(), 
-            self->head()
-        )
-    );
-
-    self->size() = Primitive::Integer(self->size().GetInteger() + 1);
-    self->head() = new_head.GetData();
+    // keys are compared with equal?
+    return Equality::Hash(key);
 }
-// TODO make this RB tree
-static Primitive Lookup(const Map* self, Primitive key) {
-    Pair* kvpair = LookupNode(self, key);
-    if (kvpair != nullptr) {
-        return Pair::GetSecond(kvpair);
-    }
-    return Primitive::Nil();
+
+bool Map::KeyEquals(Primitive k1, Primitive k2) {
+    return Equality::Equal(k1, k2);
 }
 
-static void Insert(Map* self, Heap* heap, Primitive key, Primitive value);
+Primitive* Map::Find(Map* self, Primitive key) {
+    return OpenAddressing<Map>::Find(self, key);
+}
 
-static Primitive Size(const Map* self) { return self->const_size(); }
+void Map::Insert(Heap* heap, Handle self, Handle key, Handle value) {
+    OpenAddressing<Map>::Insert(heap, self, key, value);
+}
 
-private:
-static Pair* LookupNode(const Map* self, Primitive key) {
-    Primitive current = self->const_head();
-    while (current.GetType() != Primitive::Type::Nil) {
-        Pair* casted = current.GetReference()->AsPair();
-        Pair* kvpair = Pair::GetFirst(casted).GetReference()->AsPair();
-        current = Pair::GetSecond(casted);
-        // TODO: make this deep equals
-        if (Pair::GetFirst(kvpair).ShallowEquals(&key)) {
-            return kvpair;
-        }
-    }
-    return nullptr;
+bool Map::Remove(Map* self, Primitive key) {
+    return OpenAddressing<Map>::Remove(self, key);
 }
-*/
\ No newline at end of file
@@ -0,0 +1,7 @@
+#include "objects/native_function.hh"
+#include "heap.hh"
+
+NativeFunction::NativeFunction(Handle _index, Handle _arity) : Structure() {
+    Index() = _index;
+    Arity() = _arity;
+}
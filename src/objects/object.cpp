@@ -0,0 +1,23 @@
+#include "objects/object.hh"
+#include "objects/rope.hh"
+#include "objects/string.hh"
+
+std::uint32_t Object::IdentityHash() {
+    if (IsString()) {
+        return AsString()->Hash();
+    }
+    // a rope keeps the hash of its text in the header
+    if (IsRope()) {
+        return AsRope()->Hash();
+    }
+    if (hash == 0) {
+        // golden ratio steps visit every 24 bit value before repeating
+        static std::atomic<std::uint32_t> next{0};
+        std::uint32_t assigned = 0;
+        while (assigned == 0) {
+            assigned = (next.fetch_add(1) * 0x9e3779b1u) & HASH_MASK;
+        }
+        hash = assigned;
+    }
+    return hash;
+}
@@ -0,0 +1,349 @@
+#include "objects/persistent_map.hh"
+#include "objects/map.hh"
+#include "heap.hh"
+
+PersistentMap::PersistentMap() : Structure() {
+    Count() = Integer(0);
+    Edit() = Integer(TransientEdit::NONE);
+}
+
+static Vector* asNode(Primitive node) {
+    return node.AsReference()->Value()->AsVector();
+}
+
+static std::int64_t nodeEdit(Primitive node) {
+    return asNode(node)->GetItem(Integer(0)).AsInteger()->Value();
+}
+
+static bool isCollision(Primitive node) {
+    return asNode(node)->GetItem(Integer(1)).GetType() == Primitive::Type::Nil;
+}
+
+static std::uint64_t bitmapOf(Primitive node) {
+    return asNode(node)->GetItem(Integer(1)).AsInteger()->Value();
+}
+
+static std::int64_t entryCount(Primitive node) {
+    return (asNode(node)->Length().Value() - 2) / 2;
+}
+
+static Primitive keyAt(Primitive node, std::int64_t index) {
+    return asNode(node)->GetItem(Integer(2 + 2 * index));
+}
+
+static Primitive valueAt(Primitive node, std::int64_t index) {
+    return asNode(node)->GetItem(Integer(3 + 2 * index));
+}
+
+static void setEntry(Primitive node, std::int64_t index, Primitive key, Primitive value) {
+    asNode(node)->SetItem(Integer(2 + 2 * index), key);
+    asNode(node)->SetItem(Integer(3 + 2 * index), value);
+}
+
+static std::uint64_t bitFor(std::uint64_t hash, std::int64_t shift) {
+    return std::uint64_t{1} << ((hash >> shift) & PersistentMap::MASK);
+}
+
+static std::int64_t indexFor(std::uint64_t bitmap, std::uint64_t bit) {
+    return std::popcount(bitmap & (bit - 1));
+}
+
+static bool isNil(Primitive value) {
+    return value.GetType() == Primitive::Type::Nil;
+}
+
+Primitive* PersistentMap::Find(PersistentMap* self, Primitive key) {
+    std::uint64_t hash = Map::Hash(key);
+    Primitive node = self->Root();
+
+    for (std::int64_t shift = 0; !isNil(node); shift += BITS) {
+        if (isCollision(node)) {
+            for (std::int64_t i = 0; i < entryCount(node); i++) {
+                if (Map::KeyEquals(keyAt(node, i), key)) {
+                    return asNode(node)->ItemPtr(Integer(3 + 2 * i));
+                }
+            }
+            return nullptr;
+        }
+
+        std::uint64_t bitmap = bitmapOf(node);
+        std::uint64_t bit = bitFor(hash, shift);
+        if ((bitmap & bit) == 0) {
+            return nullptr;
+        }
+
+        std::int64_t index = indexFor(bitmap, bit);
+        Primitive k = keyAt(node, index);
+        if (isNil(k)) {
+            node = valueAt(node, index);
+            continue;
+        }
+        if (Map::KeyEquals(k, key)) {
+            return asNode(node)->ItemPtr(Integer(3 + 2 * index));
+        }
+        return nullptr;
+    }
+
+    return nullptr;
+}
+
+Handle PersistentMap::Assoc(Heap* heap, Handle self, Handle key, Handle value) {
+    // validates the key before anything is allocated
+    std::uint64_t hash = Map::Hash(key.Data());
+
+    std::int64_t edit = self.AsPersistentMap()->Edit().AsInteger()->Value();
+    Handle root = heap->GetHandle(self.AsPersistentMap()->Root());
+    bool added = false;
+    Handle updated = assoc(heap, edit, root, 0, hash, key, value, &added);
+
+    if (updated.Data().Bits() == root.Data().Bits() && !added) {
+        return self;
+    }
+
+    Handle target = editable(heap, self);
+    PersistentMap* map = target.AsPersistentMap();
+    map->Root() = updated.Data();
+    if (added) {
+        map->Count() = Integer(map->Count().AsInteger()->Value() + 1);
+    }
+    return target;
+}
+
+Handle PersistentMap::Dissoc(Heap* heap, Handle self, Handle key) {
+    std::uint64_t hash = Map::Hash(key.Data());
+
+    std::int64_t edit = self.AsPersistentMap()->Edit().AsInteger()->Value();
+    Handle root = heap->GetHandle(self.AsPersistentMap()->Root());
+    bool removed = false;
+    Handle updated = dissoc(heap, edit, root, 0, hash, key, &removed);
+
+    if (!removed) {
+        return self;
+    }
+
+    Handle target = editable(heap, self);
+    PersistentMap* map = target.AsPersistentMap();
+    map->Root() = updated.Data();
+    map->Count() = Integer(map->Count().AsInteger()->Value() - 1);
+    return target;
+}
+
+Handle PersistentMap::Transient(Heap* heap, Handle self) {
+    // both would own the nodes the first one made
+    if (self.AsPersistentMap()->IsTransient()) {
+        throw std::runtime_error{"Cannot make a transient of a transient"};
+    }
+    Handle result = heap->NewPersistentMap();
+    PersistentMap* from = self.AsPersistentMap();
+    PersistentMap* to = result.AsPersistentMap();
+    to->Count() = from->Count();
+    to->Root() = from->Root();
+    to->Edit() = Integer(TransientEdit::Next());
+    return result;
+}
+
+void PersistentMap::Persistent(Handle self) {
+    self.AsPersistentMap()->Edit() = Integer(TransientEdit::NONE);
+}
+
+Handle PersistentMap::editable(Heap* heap, Handle self) {
+    if (self.AsPersistentMap()->IsTransient()) {
+        return self;
+    }
+    Handle result = heap->NewPersistentMap();
+    PersistentMap* from = self.AsPersistentMap();
+    PersistentMap* to = result.AsPersistentMap();
+    to->Count() = from->Count();
+    to->Root() = from->Root();
+    return result;
+}
+
+Handle PersistentMap::newNode(Heap* heap, std::int64_t edit, Primitive bitmap, std::int64_t entries) {
+    Handle node = heap->NewVector(2 + 2 * entries);
+    node.AsVector()->SetItem(Integer(0), Integer(edit));
+    node.AsVector()->SetItem(Integer(1), bitmap);
+    return node;
+}
+
+Handle PersistentMap::ensureEditable(Heap* heap, Handle node, std::int64_t edit) {
+    if (TransientEdit::Owns(edit, nodeEdit(node.Data()))) {
+        return node;
+    }
+    std::int64_t entries = entryCount(node.Data());
+    Handle copy = newNode(heap, edit, asNode(node.Data())->GetItem(Integer(1)), entries);
+    for (std::int64_t i = 0; i < entries; i++) {
+        setEntry(copy.Data(), i, keyAt(node.Data(), i), valueAt(node.Data(), i));
+    }
+    return copy;
+}
+
+Handle PersistentMap::assoc(Heap* heap, std::int64_t edit, Handle node, std::int64_t shift, std::uint64_t hash, Handle key, Handle value, bool* added) {
+    if (isNil(node.Data())) {
+        Handle result = newNode(heap, edit, Integer(bitFor(hash, shift)), 1);
+        setEntry(result.Data(), 0, key.Data(), value.Data());
+        *added = true;
+        return result;
+    }
+
+    std::int64_t index = 0;
+
+    if (isCollision(node.Data())) {
+        std::int64_t entries = entryCount(node.Data());
+        for (index = 0; index < entries; index++) {
+            if (Map::KeyEquals(keyAt(node.Data(), index), key.Data())) {
+                break;
+            }
+        }
+        if (index == entries) {
+            Handle result = insertEntry(heap, edit, node, Nil(), entries);
+            setEntry(result.Data(), entries, key.Data(), value.Data());
+            *added = true;
+            return result;
+        }
+    } else {
+        std::uint64_t bitmap = bitmapOf(node.Data());
+        std::uint64_t bit = bitFor(hash, shift);
+        index = indexFor(bitmap, bit);
+
+        if ((bitmap & bit) == 0) {
+            Handle result = insertEntry(heap, edit, node, Integer(bitmap | bit), index);
+            setEntry(result.Data(), index, key.Data(), value.Data());
+            *added = true;
+            return result;
+        }
+
+        Primitive existing = keyAt(node.Data(), index);
+
+        if (isNil(existing)) {
+            Handle child = heap->GetHandle(valueAt(node.Data(), index));
+            Handle updated = assoc(heap, edit, child, shift + BITS, hash, key, value, added);
+            if (updated.Data().Bits() == child.Data().Bits()) {
+                return node;
+            }
+            Handle result = ensureEditable(heap, node, edit);
+            setEntry(result.Data(), index, Nil(), updated.Data());
+            return result;
+        }
+
+        if (!Map::KeyEquals(existing, key.Data())) {
+            // another key with the same hash fragment, both move down a level
+            Handle existing_key = heap->GetHandle(existing);
+            Handle existing_value = heap->GetHandle(valueAt(node.Data(), index));
+            Handle child = pair(heap, edit, shift + BITS, existing_key, existing_value, key, value);
+            Handle result = ensureEditable(heap, node, edit);
+            setEntry(result.Data(), index, Nil(), child.Data());
+            *added = true;
+            return result;
+        }
+    }
+
+    // key is already present at index
+    if (valueAt(node.Data(), index).Bits() == value.Data().Bits()) {
+        return node;
+    }
+    Handle result = ensureEditable(heap, node, edit);
+    setEntry(result.Data(), index, key.Data(), value.Data());
+    return result;
+}
+
+Handle PersistentMap::dissoc(Heap* heap, std::int64_t edit, Handle node, std::int64_t shift, std::uint64_t hash, Handle key, bool* removed) {
+    if (isNil(node.Data())) {
+        return node;
+    }
+
+    if (isCollision(node.Data())) {
+        for (std::int64_t i = 0; i < entryCount(node.Data()); i++) {
+            if (Map::KeyEquals(keyAt(node.Data(), i), key.Data())) {
+                *removed = true;
+                return removeEntry(heap, edit, node, Nil(), i);
+            }
+        }
+        return node;
+    }
+
+    std::uint64_t bitmap = bitmapOf(node.Data());
+    std::uint64_t bit = bitFor(hash, shift);
+    if ((bitmap & bit) == 0) {
+        return node;
+    }
+
+    std::int64_t index = indexFor(bitmap, bit);
+    Primitive existing = keyAt(node.Data(), index);
+
+    if (isNil(existing)) {
+        Handle child = heap->GetHandle(valueAt(node.Data(), index));
+        Handle updated = dissoc(heap, edit, child, shift + BITS, hash, key, removed);
+        if (!*removed) {
+            return node;
+        }
+        if (isNil(updated.Data())) {
+            return removeEntry(heap, edit, node, Integer(bitmap & ~bit), index);
+        }
+        Handle result = ensureEditable(heap, node, edit);
+        if (entryCount(updated.Data()) == 1 && !isNil(keyAt(updated.Data(), 0))) {
+            // a single key is left below, it moves up into this node
+            setEntry(result.Data(), index, keyAt(updated.Data(), 0), valueAt(updated.Data(), 0));
+        } else {
+            setEntry(result.Data(), index, Nil(), updated.Data());
+        }
+        return result;
+    }
+
+    if (!Map::KeyEquals(existing, key.Data())) {
+        return node;
+    }
+
+    *removed = true;
+    return removeEntry(heap, edit, node, Integer(bitmap & ~bit), index);
+}
+
+Handle PersistentMap::pair(Heap* heap, std::int64_t edit, std::int64_t shift, Handle key1, Handle value1, Handle key2, Handle value2) {
+    if (shift >= HASH_BITS) {
+        Handle result = newNode(heap, edit, Nil(), 2);
+        setEntry(result.Data(), 0, key1.Data(), value1.Data());
+        setEntry(result.Data(), 1, key2.Data(), value2.Data());
+        return result;
+    }
+
+    std::uint64_t bit1 = bitFor(Map::Hash(key1.Data()), shift);
+    std::uint64_t bit2 = bitFor(Map::Hash(key2.Data()), shift);
+
+    if (bit1 == bit2) {
+        Handle child = pair(heap, edit, shift + BITS, key1, value1, key2, value2);
+        Handle result = newNode(heap, edit, Integer(bit1), 1);
+        setEntry(result.Data(), 0, Nil(), child.Data());
+        return result;
+    }
+
+    Handle result = newNode(heap, edit, Integer(bit1 | bit2), 2);
+    std::int64_t first = bit1 < bit2 ? 0 : 1;
+    setEntry(result.Data(), first, key1.Data(), value1.Data());
+    setEntry(result.Data(), 1 - first, key2.Data(), value2.Data());
+    return result;
+}
+
+Handle PersistentMap::insertEntry(Heap* heap, std::int64_t edit, Handle node, Primitive bitmap, std::int64_t index) {
+    std::int64_t entries = entryCount(node.Data());
+    Handle result = newNode(heap, edit, bitmap, entries + 1);
+    for (std::int64_t i = 0; i < entries; i++) {
+        std::int64_t to = i < index ? i : i + 1;
+        setEntry(result.Data(), to, keyAt(node.Data(), i), valueAt(node.Data(), i));
+    }
+    return result;
+}
+
+Handle PersistentMap::removeEntry(Heap* heap, std::int64_t edit, Handle node, Primitive bitmap, std::int64_t index) {
+    std::int64_t entries = entryCount(node.Data());
+    if (entries == 1) {
+        return heap->GetHandle(Nil());
+    }
+    Handle result = newNode(heap, edit, bitmap, entries - 1);
+    for (std::int64_t i = 0; i < entries; i++) {
+        if (i == index) {
+            continue;
+        }
+        std::int64_t to = i < index ? i : i - 1;
+        setEntry(result.Data(), to, keyAt(node.Data(), i), valueAt(node.Data(), i));
+    }
+    return result;
+}
@@ -0,0 +1,211 @@
+#include "objects/persistent_vector.hh"
+#include "heap.hh"
+
+PersistentVector::PersistentVector() : Structure() {
+    Count() = Integer(0);
+    Shift() = Integer(BITS);
+    Edit() = Integer(TransientEdit::NONE);
+}
+
+static Vector* asNode(Primitive node) {
+    return node.AsReference()->Value()->AsVector();
+}
+
+static Primitive child(Primitive node, std::int64_t index) {
+    return asNode(node)->GetItem(Integer(index + 1));
+}
+
+static void setChild(Primitive node, std::int64_t index, Primitive value) {
+    asNode(node)->SetItem(Integer(index + 1), value);
+}
+
+static std::int64_t nodeEdit(Primitive node) {
+    return asNode(node)->GetItem(Integer(0)).AsInteger()->Value();
+}
+
+static void copyFields(PersistentVector* from, PersistentVector* to) {
+    to->Count() = from->Count();
+    to->Shift() = from->Shift();
+    to->Root() = from->Root();
+    to->Tail() = from->Tail();
+}
+
+std::int64_t PersistentVector::tailOffset() const {
+    std::int64_t count = Length().Value();
+    if (count < WIDTH) {
+        return 0;
+    }
+    return ((count - 1) >> BITS) << BITS;
+}
+
+Primitive PersistentVector::Get(PersistentVector* self, Integer index) {
+    std::int64_t i = index.Value();
+    if (i < 0 || i >= self->Length().Value()) {
+        throw std::runtime_error{"Persistent vector index out of bounds"};
+    }
+    if (i >= self->tailOffset()) {
+        return child(self->Tail(), i & MASK);
+    }
+    Primitive node = self->Root();
+    for (std::int64_t level = self->Shift().AsInteger()->Value(); level > 0; level -= BITS) {
+        node = child(node, (i >> level) & MASK);
+    }
+    return child(node, i & MASK);
+}
+
+Handle PersistentVector::Set(Heap* heap, Handle self, Integer index, Handle value) {
+    std::int64_t i = index.Value();
+    std::int64_t count = self.AsPersistentVector()->Length().Value();
+    if (i == count) {
+        return Push(heap, self, value);
+    }
+    if (i < 0 || i > count) {
+        throw std::runtime_error{"Persistent vector index out of bounds"};
+    }
+
+    Handle target = editable(heap, self);
+    std::int64_t edit = target.AsPersistentVector()->Edit().AsInteger()->Value();
+
+    if (i >= target.AsPersistentVector()->tailOffset()) {
+        Handle tail = ensureEditable(heap, heap->GetHandle(target.AsPersistentVector()->Tail()), edit);
+        setChild(tail.Data(), i & MASK, value.Data());
+        target.AsPersistentVector()->Tail() = tail.Data();
+    } else {
+        std::int64_t shift = target.AsPersistentVector()->Shift().AsInteger()->Value();
+        Handle root = heap->GetHandle(target.AsPersistentVector()->Root());
+        root = setInTrie(heap, edit, shift, root, i, value);
+        target.AsPersistentVector()->Root() = root.Data();
+    }
+
+    return target;
+}
+
+Handle PersistentVector::Push(Heap* heap, Handle self, Handle value) {
+    Handle target = editable(heap, self);
+    std::int64_t edit = target.AsPersistentVector()->Edit().AsInteger()->Value();
+    std::int64_t count = target.AsPersistentVector()->Length().Value();
+    std::int64_t tail_offset = target.AsPersistentVector()->tailOffset();
+
+    if (count - tail_offset < WIDTH) {
+        // room left in the tail
+        Handle tail = heap->GetHandle(target.AsPersistentVector()->Tail());
+        if (tail.Data().GetType() == Primitive::Type::Nil) {
+            tail = newNode(heap, edit);
+        } else {
+            tail = ensureEditable(heap, tail, edit);
+        }
+        setChild(tail.Data(), count - tail_offset, value.Data());
+        target.AsPersistentVector()->Tail() = tail.Data();
+    } else {
+        // the full tail moves into the trie and a new one is started
+        Handle full = heap->GetHandle(target.AsPersistentVector()->Tail());
+        Handle root = heap->GetHandle(target.AsPersistentVector()->Root());
+        std::int64_t shift = target.AsPersistentVector()->Shift().AsInteger()->Value();
+
+        if (root.Data().GetType() == Primitive::Type::Nil) {
+            root = newNode(heap, edit);
+        }
+
+        if ((count >> BITS) > (std::int64_t{1} << shift)) {
+            // the trie is full, grow it by a level
+            Handle grown = newNode(heap, edit);
+            Handle path = newPath(heap, edit, shift, full);
+            setChild(grown.Data(), 0, root.Data());
+            setChild(grown.Data(), 1, path.Data());
+            root = grown;
+            shift += BITS;
+        } else {
+            root = pushTail(heap, edit, count, shift, root, full);
+        }
+
+        Handle tail = newNode(heap, edit);
+        setChild(tail.Data(), 0, value.Data());
+
+        PersistentVector* v = target.AsPersistentVector();
+        v->Root() = root.Data();
+        v->Tail() = tail.Data();
+        v->Shift() = Integer(shift);
+    }
+
+    target.AsPersistentVector()->Count() = Integer(count + 1);
+    return target;
+}
+
+Handle PersistentVector::Transient(Heap* heap, Handle self) {
+    // both would own the nodes the first one made
+    if (self.AsPersistentVector()->IsTransient()) {
+        throw std::runtime_error{"Cannot make a transient of a transient"};
+    }
+    Handle result = heap->NewPersistentVector();
+    copyFields(self.AsPersistentVector(), result.AsPersistentVector());
+    result.AsPersistentVector()->Edit() = Integer(TransientEdit::Next());
+    return result;
+}
+
+void PersistentVector::Persistent(Handle self) {
+    self.AsPersistentVector()->Edit() = Integer(TransientEdit::NONE);
+}
+
+Handle PersistentVector::editable(Heap* heap, Handle self) {
+    if (self.AsPersistentVector()->IsTransient()) {
+        return self;
+    }
+    Handle result = heap->NewPersistentVector();
+    copyFields(self.AsPersistentVector(), result.AsPersistentVector());
+    return result;
+}
+
+Handle PersistentVector::newNode(Heap* heap, std::int64_t edit) {
+    Handle node = heap->NewVector(WIDTH + 1);
+    node.AsVector()->SetItem(Integer(0), Integer(edit));
+    return node;
+}
+
+Handle PersistentVector::ensureEditable(Heap* heap, Handle node, std::int64_t edit) {
+    if (TransientEdit::Owns(edit, nodeEdit(node.Data()))) {
+        return node;
+    }
+    Handle copy = newNode(heap, edit);
+    for (std::int64_t i = 0; i < WIDTH; i++) {
+        setChild(copy.Data(), i, child(node.Data(), i));
+    }
+    return copy;
+}
+
+Handle PersistentVector::setInTrie(Heap* heap, std::int64_t edit, std::int64_t level, Handle node, std::int64_t index, Handle value) {
+    Handle result = ensureEditable(heap, node, edit);
+    if (level == 0) {
+        setChild(result.Data(), index & MASK, value.Data());
+        return result;
+    }
+    std::int64_t sub = (index >> level) & MASK;
+    Handle updated = setInTrie(heap, edit, level - BITS, heap->GetHandle(child(result.Data(), sub)), index, value);
+    setChild(result.Data(), sub, updated.Data());
+    return result;
+}
+
+Handle PersistentVector::pushTail(Heap* heap, std::int64_t edit, std::int64_t count, std::int64_t level, Handle parent, Handle tail) {
+    Handle result = ensureEditable(heap, parent, edit);
+    std::int64_t sub = ((count - 1) >> level) & MASK;
+    Handle inserted = tail;
+    if (level != BITS) {
+        Primitive existing = child(result.Data(), sub);
+        if (existing.GetType() == Primitive::Type::Nil) {
+            inserted = newPath(heap, edit, level - BITS, tail);
+        } else {
+            inserted = pushTail(heap, edit, count, level - BITS, heap->GetHandle(existing), tail);
+        }
+    }
+    setChild(result.Data(), sub, inserted.Data());
+    return result;
+}
+
+Handle PersistentVector::newPath(Heap* heap, std::int64_t edit, std::int64_t level, Handle node) {
+    if (level == 0) {
+        return node;
+    }
+    Handle result = newNode(heap, edit);
+    Handle inner = newPath(heap, edit, level - BITS, node);
+    setChild(result.Data(), 0, inner.Data());
+    return result;
+}
@@ -0,0 +1,6 @@
+#include "objects/prompt.hh"
+#include "heap.hh"
+
+Prompt::Prompt(Handle _tag) : Structure() {
+    Tag() = _tag;
+}
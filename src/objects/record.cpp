@@ -0,0 +1,6 @@
+#include "objects/record.hh"
+#include "heap.hh"
+
+Record::Record(std::size_t fields, Handle descriptor) : SlottedObject(Object::Type::Record, AllocationSize(fields)) {
+    Descriptor() = descriptor;
+}
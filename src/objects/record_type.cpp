@@ -0,0 +1,7 @@
+#include "objects/record_type.hh"
+#include "heap.hh"
+
+RecordType::RecordType(Handle _name, Handle _fields) : Structure() {
+    Name() = _name;
+    Fields() = _fields;
+}
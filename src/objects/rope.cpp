@@ -0,0 +1,201 @@
+#include "objects/rope.hh"
+#include "heap.hh"
+
+Rope::Rope(Handle _left, Handle _right, Handle _length) : Structure() {
+    Left() = _left;
+    Right() = _right;
+    Length() = _length;
+}
+
+static std::string collect(Primitive str, std::int64_t start, std::int64_t length);
+
+static bool isFlat(Primitive str) {
+    return str.GetType() == Primitive::Type::Reference
+        && str.AsReference()->Value()->IsString();
+}
+
+Integer Rope::LengthOf(Primitive str) {
+    Object* obj = str.AsReference()->Value();
+    if (obj->IsString()) {
+        return obj->AsString()->Length();
+    }
+    return *obj->AsRope()->Length().AsInteger();
+}
+
+Handle Rope::Concat(Heap* heap, Handle left, Handle right) {
+    std::int64_t left_length = Rope::LengthOf(left.Data()).Value();
+    std::int64_t right_length = Rope::LengthOf(right.Data()).Value();
+
+    if (left_length == 0) {
+        return right;
+    }
+
+    if (right_length == 0) {
+        return left;
+    }
+
+    std::int64_t length = left_length + right_length;
+
+    if (length <= FLAT_LIMIT) {
+        std::string joined = ToStdString(left.Data());
+        joined.append(ToStdString(right.Data()));
+        return heap->NewString(joined);
+    }
+
+    return heap->NewRope(left, right, heap->GetHandle(Integer(length)));
+}
+
+Handle Rope::Slice(Heap* heap, Handle source, Integer start, Integer length) {
+    std::int64_t source_length = Rope::LengthOf(source.Data()).Value();
+
+    if (start.Value() < 0 || length.Value() < 0 || start.Value() + length.Value() > source_length) {
+        throw std::runtime_error{"Rope slice out of bounds"};
+    }
+
+    if (start.Value() == 0 && length.Value() == source_length) {
+        return source;
+    }
+
+    if (length.Value() <= FLAT_LIMIT) {
+        return heap->NewString(collect(source.Data(), start.Value(), length.Value()));
+    }
+
+    // slices of slices point straight at the underlying source
+    std::int64_t offset = start.Value();
+    Handle target = source;
+    if (!isFlat(source.Data()) && source.AsRope()->IsSlice()) {
+        offset += source.AsRope()->Right().AsInteger()->Value();
+        target = heap->GetHandle(source.AsRope()->Left());
+    }
+
+    return heap->NewRope(
+        target,
+        heap->GetHandle(Integer(offset)),
+        heap->GetHandle(length)
+    );
+}
+
+Handle Rope::Flatten(Heap* heap, Handle str) {
+    if (isFlat(str.Data())) {
+        return str;
+    }
+
+    Rope* rope = str.AsRope();
+    if (rope->IsSlice() && isFlat(rope->Left())) {
+        Integer offset = *rope->Right().AsInteger();
+        if (offset.Value() == 0 && Rope::LengthOf(rope->Left()).Value() == rope->Length().AsInteger()->Value()) {
+            return heap->GetHandle(rope->Left());
+        }
+    }
+
+    DEBUGLN("Flattening rope of length " << Rope::LengthOf(str.Data()).Value());
+
+    Handle flat = heap->NewString(ToStdString(str.Data()));
+
+    // the allocation above may have moved the rope, so reload it
+    rope = str.AsRope();
+    rope->Left() = flat;
+    rope->Right() = Integer(0);
+
+    return flat;
+}
+
+Character Rope::GetChar(Heap* heap, Handle str, Integer index) {
+    if (isFlat(str.Data())) {
+        return str.AsString()->GetChar(index);
+    }
+
+    Rope* rope = str.AsRope();
+
+    if (index.Value() < 0 || index.Value() >= rope->Length().AsInteger()->Value()) {
+        throw std::runtime_error{"String index out of bounds"};
+    }
+
+    // slices over flat strings never need to be copied
+    if (rope->IsSlice() && isFlat(rope->Left())) {
+        Integer offset = *rope->Right().AsInteger();
+        const String* source = rope->Left().AsReference()->Value()->AsConstString();
+        return source->GetChar(Integer(offset.Value() + index.Value()));
+    }
+
+    Flatten(heap, str);
+
+    return GetChar(heap, str, index);
+}
+
+std::string Rope::ToStdString(Primitive str) {
+    return collect(str, 0, Rope::LengthOf(str).Value());
+}
+
+// utf-8 bytes of the codepoints in [start, start + length) of str
+static std::string collect(Primitive str, std::int64_t start, std::int64_t length) {
+    std::string result;
+    result.reserve(length);
+
+    Rope::Leaves leaves{str, start, length};
+    for (std::string_view piece = leaves.Next(); !piece.empty(); piece = leaves.Next()) {
+        result.append(piece);
+    }
+
+    return result;
+}
+
+std::uint32_t Rope::Hash() const {
+    std::uint32_t cached = CachedHash();
+    if (cached != 0) {
+        return cached;
+    }
+    std::uint64_t h = String::HASH_SEED;
+    Leaves leaves{Reference(const_cast<Rope*>(this))};
+    for (std::string_view piece = leaves.Next(); !piece.empty(); piece = leaves.Next()) {
+        h = String::HashMore(h, piece.data(), piece.size());
+    }
+    std::uint32_t computed = String::HashFold(h);
+    const_cast<Rope*>(this)->SetCachedHash(computed);
+    return computed;
+}
+
+Rope::Leaves::Leaves(Primitive str, std::int64_t start, std::int64_t length) {
+    work.push_back(Work{str, start, length});
+}
+
+std::string_view Rope::Leaves::Next() {
+    while (!work.empty()) {
+        Work current = work.back();
+        work.pop_back();
+
+        if (current.length == 0) {
+            continue;
+        }
+
+        Object* obj = current.node.AsReference()->Value();
+
+        if (obj->IsString()) {
+            const String* s = obj->AsConstString();
+            return s->SubstringView(Integer(current.start), Integer(current.length));
+        }
+
+        Rope* rope = obj->AsRope();
+
+        if (rope->IsSlice()) {
+            std::int64_t offset = rope->Right().AsInteger()->Value();
+            work.push_back(Work{rope->Left(), offset + current.start, current.length});
+            continue;
+        }
+
+        std::int64_t left_length = Rope::LengthOf(rope->Left()).Value();
+        std::int64_t end = current.start + current.length;
+
+        // right is pushed first so that left comes out first
+        if (end > left_length) {
+            std::int64_t right_start = std::max<std::int64_t>(current.start - left_length, 0);
+            work.push_back(Work{rope->Right(), right_start, end - left_length - right_start});
+        }
+
+        if (current.start < left_length) {
+            work.push_back(Work{rope->Left(), current.start, std::min(end, left_length) - current.start});
+        }
+    }
+
+    return std::string_view{};
+}
@@ -1,16 +1,21 @@
 #include "objects/stack.hh"
 #include "heap.hh"
 
+Stack::Stack() : Structure() {}
+
 void Stack::Push(Heap* heap, Handle stack, Handle item) {
-    stack.AsStack()->Head() = heap->NewPair(
+    Handle head = heap->NewPair(
         item,
         heap->GetHandle(stack.AsStack()->Head())
     );
+    stack.AsStack()->Head() = head;
 }
 
-
-static Handle Pop(Heap* heap, Handle stack) {
+Handle Stack::Pop(Heap* heap, Handle stack) {
+    if (stack.AsStack()->Head().GetType() == Primitive::Type::Nil) {
+        throw std::runtime_error{"Pop called on empty stack"};
+    }
     Handle head = heap->GetHandle(stack.AsStack()->Head());
     stack.AsStack()->Head() = head.AsPair()->Second();
     return heap->GetHandle(head.AsPair()->First());
-}
\ No newline at end of file
+}
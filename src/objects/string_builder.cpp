@@ -0,0 +1,109 @@
+#include "objects/string_builder.hh"
+#include "objects/rope.hh"
+#include "heap.hh"
+
+StringBuilder::StringBuilder() : Structure() {
+    reset(this);
+}
+
+void StringBuilder::reset(StringBuilder* self) {
+    self->Count() = Integer(0);
+    self->Length() = Integer(0);
+    self->Buffer() = Nil();
+}
+
+std::size_t StringBuilder::capacity(StringBuilder* self) {
+    if (self->Buffer().GetType() == Primitive::Type::Nil) {
+        return 0;
+    }
+    String* buffer = self->Buffer().AsReference()->Value()->AsString();
+    return buffer->GetAllocationSize() - String::MinAllocationSize();
+}
+
+char* StringBuilder::bytes(StringBuilder* self) {
+    // the buffer is an empty string, so nothing comes before its bytes
+    return self->Buffer().AsReference()->Value()->AsString()->chars();
+}
+
+char* StringBuilder::reserve(Heap* heap, Handle self, std::size_t count) {
+    std::size_t used = self.AsStringBuilder()->Count().AsInteger()->Value();
+    std::size_t old_capacity = capacity(self.AsStringBuilder());
+
+    if (used + count > old_capacity) {
+        std::size_t new_capacity = std::max(old_capacity * 2, INITIAL_CAPACITY);
+        while (new_capacity < used + count) {
+            new_capacity *= 2;
+        }
+
+        DEBUGLN("Growing string builder from " << old_capacity << " to " << new_capacity);
+
+        Handle fresh = heap->NewStringBuffer(new_capacity);
+        if (used != 0) {
+            std::memcpy(fresh.AsString()->chars(), bytes(self.AsStringBuilder()), used);
+        }
+        self.AsStringBuilder()->Buffer() = fresh;
+    }
+
+    return &bytes(self.AsStringBuilder())[used];
+}
+
+void StringBuilder::appendBytes(Heap* heap, Handle self, const std::string& text) {
+    char* dest = reserve(heap, self, text.size());
+    std::memcpy(dest, text.data(), text.size());
+    StringBuilder* builder = self.AsStringBuilder();
+    builder->Count() = Integer(builder->Count().AsInteger()->Value() + text.size());
+    builder->Length() = Integer(builder->Length().AsInteger()->Value() + Utf8Length(text));
+}
+
+void StringBuilder::Append(Heap* heap, Handle self, Handle value) {
+    Primitive data = value.Data();
+
+    if (data.GetType() == Primitive::Type::Character) {
+        std::string encoded;
+        Utf8Encode(data.AsCharacter()->Value(), encoded);
+        appendBytes(heap, self, encoded);
+        return;
+    }
+
+    Object* obj = data.AsReference()->Value();
+
+    if (obj->IsRope()) {
+        appendBytes(heap, self, Rope::ToStdString(data));
+        return;
+    }
+
+    // copied straight out of the string once there is room for it, the
+    // string may have moved while making room
+    std::size_t count = obj->AsString()->ByteLength().Value();
+    std::int64_t codepoints = obj->AsString()->Length().Value();
+    char* dest = reserve(heap, self, count);
+    std::memcpy(dest, value.AsString()->chars(), count);
+    StringBuilder* builder = self.AsStringBuilder();
+    builder->Count() = Integer(builder->Count().AsInteger()->Value() + count);
+    builder->Length() = Integer(builder->Length().AsInteger()->Value() + codepoints);
+}
+
+Handle StringBuilder::Finish(Heap* heap, Handle self) {
+    StringBuilder* builder = self.AsStringBuilder();
+
+    if (builder->Buffer().GetType() == Primitive::Type::Nil) {
+        return heap->NewString("");
+    }
+
+    std::int64_t count = builder->Count().AsInteger()->Value();
+    std::int64_t codepoints = builder->Length().AsInteger()->Value();
+
+    if (count != codepoints) {
+        std::string text{bytes(builder), static_cast<std::size_t>(count)};
+        reset(builder);
+        return heap->NewString(text);
+    }
+
+    Handle result = heap->GetHandle(builder->Buffer());
+    String* finished = result.AsString();
+    *finished->length() = Integer(count);
+    finished->header()->byte_length = count;
+    finished->ShrinkAllocationSize(String::BufferAllocationSize(count));
+    reset(self.AsStringBuilder());
+    return result;
+}
@@ -0,0 +1,6 @@
+#include "objects/vector.hh"
+#include "objects/integer.hh"
+
+Vector::Vector(std::size_t items) : SlottedObject(Object::Type::Vector, AllocationSize(items)) {
+    SlotRef(0) = Integer(items);
+}
@@ -0,0 +1,83 @@
+#ifndef TESTS_HARNESS_HH__
+#define TESTS_HARNESS_HH__
+
+#include "vm.hh"
+
+#include <iostream>
+
+// reads the list form of bytecode, (...) is a list and [...] a Vector
+class Reader {
+public:
+    Reader(VirtualMachine& _vm, std::string_view _text) : vm{_vm}, text{_text} {}
+
+    Handle Read() {
+        Heap& heap = vm.GetHeap();
+        skipSpace();
+        if (text[at] == '(' || text[at] == '[') {
+            char close = text[at] == '(' ? ')' : ']';
+            at += 1;
+            std::vector<Handle> items;
+            for (skipSpace(); text[at] != close; skipSpace()) {
+                items.push_back(Read());
+            }
+            at += 1;
+            if (close == ')') {
+                Handle list = heap.GetHandle(Nil());
+                for (std::size_t i = items.size(); i > 0; i--) {
+                    list = heap.NewPair(items[i - 1], list);
+                }
+                return list;
+            }
+            Handle vector = heap.NewVector(items.size());
+            for (std::size_t i = 0; i < items.size(); i++) {
+                vector.AsVector()->SetItem(Integer(i), items[i].Data());
+            }
+            return vector;
+        }
+        std::size_t start = at;
+        while (at < text.size() && !std::isspace(text[at]) && text[at] != ')' && text[at] != ']') {
+            at += 1;
+        }
+        std::string token{text.substr(start, at - start)};
+        if (token == "#t" || token == "#f") {
+            return heap.GetHandle(Boolean(token == "#t"));
+        }
+        if (std::isdigit(token[0])) {
+            return heap.GetHandle(Integer(std::stoll(token)));
+        }
+        return heap.GetHandle(vm.GetSymbolTable().Intern(token));
+    }
+
+private:
+    void skipSpace() {
+        while (at < text.size() && std::isspace(text[at])) {
+            at += 1;
+        }
+    }
+
+    VirtualMachine& vm;
+    std::string_view text;
+    std::size_t at = 0;
+};
+
+inline int failures = 0;
+
+inline void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures += 1;
+    }
+}
+
+inline std::int64_t run(VirtualMachine& vm, std::string_view program) {
+    Reader reader{vm, program};
+    return vm.Run(reader.Read()).Data().AsInteger()->Value();
+}
+
+// runs a program for what it does to the globals
+inline void define(VirtualMachine& vm, std::string_view program) {
+    Reader reader{vm, program};
+    vm.Run(reader.Read());
+}
+
+#endif // TESTS_HARNESS_HH__
@@ -0,0 +1,87 @@
+#include "harness.hh"
+
+int main() {
+    // small enough that building the collections collects several times
+    VirtualMachine vm{512 * 1024};
+
+    // v1 holds 0, 10, ..., 9990
+    define(vm, R"([
+        (lambda [i v] [
+            (loadglobal =) (loadlocal 0 0) (literal 1000) (invoke 3) (jumpiffalse 3)
+            (loadlocal 0 1) (jump 14)
+            (loadglobal fill) (loadglobal +) (loadlocal 0 0) (literal 1) (invoke 3)
+            (loadglobal persistent-vector-conj) (loadlocal 0 1)
+            (loadglobal *) (loadlocal 0 0) (literal 10) (invoke 3) (invoke 3)
+            (invoketail 3)
+            (return)] 2 0 #f)
+        (defineglobal fill) (pop)
+        (loadglobal fill) (literal 0) (loadglobal make-persistent-vector) (invoke 1) (invoke 3)
+        (defineglobal v1) (pop)
+        (loadglobal persistent-vector-set) (loadglobal v1) (literal 500) (literal 7) (invoke 4)
+        (defineglobal v2) (pop)
+        (loadglobal persistent-vector-conj) (loadglobal v1) (literal 99) (invoke 3)
+        (defineglobal v3) (pop)
+        (loadglobal persistent-vector-conj) (loadglobal v1) (literal 77) (invoke 3)
+        (defineglobal v4) (pop)
+        (literal 0)
+    ])");
+    check(run(vm, "[(loadglobal persistent-vector-length) (loadglobal v1) (invoke 2)]") == 1000, "v1 has every item");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal v1) (literal 999) (invoke 3)]") == 9990, "v1 reads back its last item");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal v1) (literal 500) (invoke 3)]") == 5000, "setting in v2 leaves v1 alone");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal v2) (literal 500) (invoke 3)]") == 7, "v2 sees its own set");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal v2) (literal 501) (invoke 3)]") == 5010, "v2 shares the rest with v1");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal v3) (literal 1000) (invoke 3)]") == 99, "v3 keeps its own push");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal v4) (literal 1000) (invoke 3)]") == 77, "v4 keeps its own push");
+    check(run(vm, "[(loadglobal persistent-vector-length) (loadglobal v1) (invoke 2)]") == 1000, "pushing to v3 and v4 leaves v1 alone");
+
+    // a transient updates itself, the vector it came from stays as it was
+    define(vm, R"([
+        (loadglobal transient) (loadglobal v1) (invoke 2) (defineglobal t) (pop)
+        (loadglobal persistent-vector-set) (loadglobal t) (literal 0) (literal 1) (invoke 4) (pop)
+        (loadglobal persistent-vector-conj) (loadglobal t) (literal 5) (invoke 3) (pop)
+        (loadglobal persistent!) (loadglobal t) (invoke 2) (pop)
+        (literal 0)
+    ])");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal t) (literal 0) (invoke 3)]") == 1, "the transient was updated in place");
+    check(run(vm, "[(loadglobal persistent-vector-length) (loadglobal t) (invoke 2)]") == 1001, "the transient pushed in place");
+    check(run(vm, "[(loadglobal persistent-vector-ref) (loadglobal v1) (literal 0) (invoke 3)]") == 0, "the transient left v1 alone");
+
+    bool rejected = false;
+    try {
+        run(vm, "[(loadglobal transient) (loadglobal transient) (loadglobal v1) (invoke 2) (invoke 2)]");
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    check(rejected, "a transient of a transient is rejected");
+
+    // m1 maps 0, 1, ..., 999 to twice themselves
+    define(vm, R"([
+        (lambda [i m] [
+            (loadglobal =) (loadlocal 0 0) (literal 1000) (invoke 3) (jumpiffalse 3)
+            (loadlocal 0 1) (jump 15)
+            (loadglobal fillmap) (loadglobal +) (loadlocal 0 0) (literal 1) (invoke 3)
+            (loadglobal persistent-map-assoc) (loadlocal 0 1) (loadlocal 0 0)
+            (loadglobal *) (loadlocal 0 0) (literal 2) (invoke 3) (invoke 4)
+            (invoketail 3)
+            (return)] 2 0 #f)
+        (defineglobal fillmap) (pop)
+        (loadglobal fillmap) (literal 0) (loadglobal make-persistent-map) (invoke 1) (invoke 3)
+        (defineglobal m1) (pop)
+        (loadglobal persistent-map-assoc) (loadglobal m1) (literal 500) (literal 1) (invoke 4)
+        (defineglobal m2) (pop)
+        (loadglobal persistent-map-dissoc) (loadglobal m1) (literal 7) (invoke 3)
+        (defineglobal m3) (pop)
+        (literal 0)
+    ])");
+    check(run(vm, "[(loadglobal persistent-map-count) (loadglobal m1) (invoke 2)]") == 1000, "m1 has every key");
+    check(run(vm, "[(loadglobal persistent-map-ref) (loadglobal m1) (literal 999) (literal 0) (invoke 4)]") == 1998, "m1 reads back its last key");
+    check(run(vm, "[(loadglobal persistent-map-ref) (loadglobal m1) (literal 500) (literal 0) (invoke 4)]") == 1000, "assoc into m2 leaves m1 alone");
+    check(run(vm, "[(loadglobal persistent-map-ref) (loadglobal m2) (literal 500) (literal 0) (invoke 4)]") == 1, "m2 sees its own assoc");
+    check(run(vm, "[(loadglobal persistent-map-ref) (loadglobal m2) (literal 501) (literal 0) (invoke 4)]") == 1002, "m2 shares the rest with m1");
+    check(run(vm, "[(loadglobal persistent-map-count) (loadglobal m2) (invoke 2)]") == 1000, "replacing a value keeps the count");
+    check(run(vm, "[(loadglobal persistent-map-ref) (loadglobal m3) (literal 7) (literal 12345) (invoke 4)]") == 12345, "m3 lost its key");
+    check(run(vm, "[(loadglobal persistent-map-count) (loadglobal m3) (invoke 2)]") == 999, "m3 counts one key less");
+    check(run(vm, "[(loadglobal persistent-map-ref) (loadglobal m1) (literal 7) (literal 0) (invoke 4)]") == 14, "dissoc from m3 leaves m1 alone");
+
+    return failures == 0 ? 0 : 1;
+}
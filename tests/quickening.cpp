@@ -0,0 +1,43 @@
+#include "harness.hh"
+
+int main() {
+    VirtualMachine vm;
+
+    // the + in add is quickened on its second call and add is compiled
+    // once it is hot, with the site already quickened
+    std::int64_t sum = run(vm, R"([
+        (lambda [a b] [(loadglobal +) (loadlocal 0 0) (loadlocal 0 1) (invoke 3) (return)] 2 0 #f)
+        (defineglobal add) (pop)
+        (lambda [i acc] [
+            (loadglobal =) (loadlocal 0 0) (literal 0) (invoke 3) (jumpiffalse 3)
+            (loadlocal 0 1) (jump 11)
+            (loadglobal loop) (loadglobal -) (loadlocal 0 0) (literal 1) (invoke 3)
+            (loadglobal add) (loadlocal 0 1) (loadlocal 0 0) (invoke 3) (invoketail 3)
+            (return)] 2 0 #f)
+        (defineglobal loop) (pop)
+        (loadglobal loop) (literal 200) (literal 0) (invoke 3)
+    ])");
+    check(sum == 20100, "hot loop sums 1 to 200");
+
+    VirtualMachine::QuickeningStatistics hot = vm.GetQuickeningStatistics();
+    check(hot.quickened > 0, "the integer call sites are quickened");
+    check(hot.despecialized == 0, "integer arguments never fail a guard");
+
+    // non integers fail the guard of the site in add once, after which it
+    // stays a generic invoke, for integers too. + itself may reject them
+    for (int i = 0; i < 3; i++) {
+        try {
+            run(vm, "[(loadglobal add) (literal #t) (literal 1) (invoke 3)]");
+        } catch (const std::runtime_error&) {
+        }
+    }
+    std::int64_t value = run(vm, "[(loadglobal add) (literal 2) (literal 3) (invoke 3)]");
+    check(value == 5, "the de-specialized site still adds");
+
+    VirtualMachine::QuickeningStatistics after = vm.GetQuickeningStatistics();
+    check(after.despecialized == 1, "the guard fails once and is not run again");
+    // the only new quickenings are the loadglobal of each of the 4 runs
+    check(after.quickened == hot.quickened + 4, "a de-specialized site is not quickened again");
+
+    return failures == 0 ? 0 : 1;
+}